@@ -0,0 +1,153 @@
+/*** arena.c -- address space reserved up front
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "nifty.h"
+
+#if !defined MAP_ANONYMOUS && defined MAP_ANON
+# define MAP_ANONYMOUS	MAP_ANON
+#endif	/* !MAP_ANONYMOUS && MAP_ANON */
+#if !defined MAP_NORESERVE
+# define MAP_NORESERVE	0
+#endif	/* !MAP_NORESERVE */
+
+/* default reservation, plenty for any index, costs no memory */
+#define ARENA_RESV	((size_t)1U << (sizeof(size_t) > 4U ? 40U : 28U))
+
+static inline size_t
+huge(size_t z)
+{
+/* round Z up to a multiple of ARENA_HUGE */
+	return (z + (ARENA_HUGE - 1U)) & ~(size_t)(ARENA_HUGE - 1U);
+}
+
+static inline size_t
+page(size_t z)
+{
+/* round Z up to a multiple of the page size */
+	static size_t pgsz;
+
+	if (UNLIKELY(!pgsz)) {
+		const long r = sysconf(_SC_PAGESIZE);
+
+		pgsz = r > 0 ? (size_t)r : 4096U;
+	}
+	return (z + (pgsz - 1U)) & ~(pgsz - 1U);
+}
+
+static int
+reserve(struct arena_s *a, size_t z)
+{
+/* reserve the default range or Z bytes if that's more, retry
+ * with less if the address space is limited */
+	size_t r = huge(z > ARENA_RESV ? z : ARENA_RESV);
+
+	for (;; r = huge(r / 2U)) {
+		/* one more huge page for alignment */
+		const size_t m = r + ARENA_HUGE;
+		char *p = mmap(NULL, m, PROT_NONE,
+			       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			       -1, 0);
+		char *b;
+
+		if (p == MAP_FAILED && (r / 2U < z || r <= ARENA_HUGE)) {
+			return -1;
+		} else if (p == MAP_FAILED) {
+			continue;
+		}
+		b = p + (huge((uintptr_t)p) - (uintptr_t)p);
+		/* trim to R bytes starting at B */
+		if (b > p) {
+			munmap(p, b - p);
+		}
+		munmap(b + r, p + m - (b + r));
+		a->base = b;
+		a->resv = r;
+		a->comm = 0U;
+		a->used = 0U;
+		return 0;
+	}
+}
+
+int
+arena_commit(struct arena_s *a, size_t z)
+{
+	size_t c;
+
+	if (UNLIKELY(a->base == NULL) && UNLIKELY(reserve(a, z) < 0)) {
+		return -1;
+	} else if (UNLIKELY(z > a->resv)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	/* commit geometrically, saves on system calls, small arenas
+	 * stay in small pages so tiny runs fault in next to nothing */
+	c = z > 2U * a->comm ? z : 2U * a->comm;
+	c = c < ARENA_HUGE ? page(c) : huge(c);
+	if (c > a->resv) {
+		c = a->resv;
+	}
+	if (UNLIKELY(mprotect(a->base + a->comm, c - a->comm,
+			      PROT_READ | PROT_WRITE) < 0)) {
+		return -1;
+	}
+#if defined MADV_HUGEPAGE
+	if (c >= ARENA_HUGE && a->comm < ARENA_HUGE) {
+		(void)madvise(a->base, a->resv, MADV_HUGEPAGE);
+	}
+#endif	/* MADV_HUGEPAGE */
+	a->comm = c;
+	return 0;
+}
+
+void
+arena_fini(struct arena_s *a)
+{
+	if (a->base != NULL) {
+		munmap(a->base, a->resv);
+	}
+	*a = (struct arena_s){NULL};
+	return;
+}
+
+/* arena.c ends here */
@@ -0,0 +1,90 @@
+/*** arena.h -- address space reserved up front
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_arena_h_
+#define INCLUDED_arena_h_
+#include <stddef.h>
+#include "nifty.h"
+
+/* An arena is one contiguous range of address space reserved up front
+ * and committed from the front as it grows, so data never moves.
+ * Ranges are aligned to ARENA_HUGE and committed page-wise until they
+ * reach it, from then on in multiples of ARENA_HUGE and marked for
+ * transparent huge pages where the system has them. */
+#define ARENA_HUGE	(2U * 1024U * 1024U)
+
+struct arena_s {
+	char *base;
+	/* bytes reserved, committed and handed out */
+	size_t resv;
+	size_t comm;
+	size_t used;
+};
+
+/**
+ * Commit at least Z bytes of A, reserve A if need be.
+ * Return -1 if the reservation of A is exhausted or out of memory. */
+extern int arena_commit(struct arena_s *a, size_t z);
+
+/**
+ * Give back all memory of A and reset it. */
+extern void arena_fini(struct arena_s *a);
+
+/**
+ * Return the beginning of A with at least Z bytes usable, or NULL.
+ * Earlier contents stay where they are. */
+static inline void*
+arena_grow(struct arena_s *a, size_t z)
+{
+	if (UNLIKELY(z > a->comm) && UNLIKELY(arena_commit(a, z) < 0)) {
+		return NULL;
+	}
+	if (z > a->used) {
+		a->used = z;
+	}
+	return a->base;
+}
+
+/**
+ * Declare only the first Z bytes of A to be in use. */
+static inline void
+arena_trim(struct arena_s *a, size_t z)
+{
+	a->used = z;
+	return;
+}
+
+#endif	/* INCLUDED_arena_h_ */
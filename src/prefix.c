@@ -0,0 +1,380 @@
+/*** prefix.c -- prefix filter join
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "prefix.h"
+#include "nifty.h"
+
+struct prefix_s {
+	qgidx_t idx;
+	qgram_f mkqgrams;
+	double thr;
+	/* global qgram order, rank of qgram number G */
+	uint32_t *rank;
+	/* qgram set of factor F as ascending ranks,
+	 * RSET[ROFF[F - 1U]] to RSET[ROFF[F]] */
+	size_t *roff;
+	uint32_t *rset;
+	/* factors with rank R in their prefix,
+	 * PPOST[PPOFF[R]] to PPOST[PPOFF[R + 1U]] */
+	size_t *ppoff;
+	factor_t *ppost;
+	/* probe scratch, factor F is a candidate of probe STAMP[F - 1U] */
+	size_t *stamp;
+	size_t nprobe;
+	factor_t *cand;
+	size_t zcand;
+	struct prefix_hit_s *hit;
+	size_t zhit;
+	/* statistics */
+	size_t nscan;
+	size_t ncand;
+};
+
+static inline size_t
+atleast(double x)
+{
+/* ceil() of X, robust against X being a hair above an integer */
+	const double y = x - 1e-9;
+	const size_t r = y > 0. ? (size_t)y : 0U;
+
+	return r + ((double)r < y);
+}
+
+static inline size_t
+plen(size_t n, double thr)
+{
+/* prefix length of a set of N qgrams */
+	return n ? n - atleast(thr * (double)n) + 1U : 0U;
+}
+
+static int
+cmp_qgram(const void *x, const void *y)
+{
+	const qgram_t a = *(const qgram_t*)x, b = *(const qgram_t*)y;
+	return (a > b) - (a < b);
+}
+
+static int
+cmp_u32(const void *x, const void *y)
+{
+	const uint32_t a = *(const uint32_t*)x, b = *(const uint32_t*)y;
+	return (a > b) - (a < b);
+}
+
+struct ord_s {
+	size_t n;
+	qgram_t key;
+	size_t gram;
+};
+
+static int
+cmp_ord(const void *x, const void *y)
+{
+/* ascending document frequency, then key */
+	const struct ord_s *a = x, *b = y;
+
+	if (a->n != b->n) {
+		return (a->n > b->n) - (a->n < b->n);
+	}
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+/* for sorting hits into input order */
+static const factor_t *ford;
+
+static int
+cmp_hit(const void *x, const void *y)
+{
+	const struct prefix_hit_s *a = x, *b = y;
+	const factor_t u = ford ? ford[a->f - 1U] : a->f;
+	const factor_t v = ford ? ford[b->f - 1U] : b->f;
+	return (u > v) - (u < v);
+}
+
+static size_t
+qset(const struct prefix_s *px, const char *s, size_t z,
+     uint32_t *restrict r, size_t *unk)
+{
+/* put the ranks of the distinct qgrams of S of length Z into R in
+ * ascending order and return their number, qgrams unknown to the
+ * index are just counted in *UNK */
+	const qgidx_t idx = px->idx;
+	qgram_t x[z - idx->q + 1U];
+	const size_t m = px->mkqgrams(x, s, z);
+	size_t k = 0U, u = 0U;
+
+	qsort(x, m, sizeof(*x), cmp_qgram);
+	for (size_t i = 0U; i < m; i++) {
+		uint32_t g;
+
+		if (i && x[i] == x[i - 1U]) {
+			continue;
+		} else if ((g = qgidx_gram(idx, x[i]))) {
+			r[k++] = px->rank[g];
+		} else {
+			u++;
+		}
+	}
+	qsort(r, k, sizeof(*r), cmp_u32);
+	*unk = u;
+	return k;
+}
+
+static size_t
+overlap(const uint32_t *a, size_t na, const uint32_t *b, size_t nb)
+{
+/* number of elements common to the ascending sets A and B */
+	size_t o = 0U;
+
+	for (size_t i = 0U, j = 0U; i < na && j < nb;) {
+		if (a[i] < b[j]) {
+			i++;
+		} else if (a[i] > b[j]) {
+			j++;
+		} else {
+			o++, i++, j++;
+		}
+	}
+	return o;
+}
+
+
+prefix_t
+prefix_build(qgidx_t idx, double thr)
+{
+	struct prefix_s *px;
+	struct ord_s *ord;
+	size_t nrank = 0U, nrset = 0U, zrset = 0U;
+	size_t *fill;
+
+	if (UNLIKELY((px = calloc(1, sizeof(*px))) == NULL)) {
+		return NULL;
+	}
+	px->idx = idx;
+	px->thr = thr;
+	px->mkqgrams = qgidx_kernel(idx->q, idx->flags);
+
+	/* global order */
+	px->rank = malloc(idx->ndir * sizeof(*px->rank));
+	ord = malloc(idx->ndir * sizeof(*ord));
+	if (UNLIKELY(px->rank == NULL || ord == NULL)) {
+		free(ord);
+		goto nope;
+	}
+	for (size_t g = 1U; g < idx->ndir; g++) {
+		ord[nrank++] = (struct ord_s){
+			idx->dir[g].n, idx->dir[g].key, g
+		};
+	}
+	qsort(ord, nrank, sizeof(*ord), cmp_ord);
+	for (size_t i = 0U; i < nrank; i++) {
+		px->rank[ord[i].gram] = i;
+	}
+	free(ord);
+
+	/* qgram sets */
+	if (UNLIKELY((px->roff = malloc((idx->nfactor + 1U) *
+					sizeof(*px->roff))) == NULL)) {
+		goto nope;
+	}
+	px->roff[0U] = 0U;
+	for (factor_t f = 1U; f <= idx->nfactor; f++) {
+		size_t z, unk;
+		const char *s = qgidx_factor(idx, f, &z);
+
+		if (UNLIKELY(nrset + z >= zrset)) {
+			uint32_t *nu;
+
+			zrset = 2U * (zrset + z);
+			nu = realloc(px->rset, zrset * sizeof(*px->rset));
+			if (UNLIKELY(nu == NULL)) {
+				goto nope;
+			}
+			px->rset = nu;
+		}
+		nrset += qset(px, s, z, px->rset + nrset, &unk);
+		px->roff[f] = nrset;
+	}
+
+	/* prefix postings */
+	px->ppoff = calloc(nrank + 2U, sizeof(*px->ppoff));
+	fill = NULL;
+	if (UNLIKELY(px->ppoff == NULL)) {
+		goto nope;
+	}
+	for (factor_t f = 1U; f <= idx->nfactor; f++) {
+		const uint32_t *r = px->rset + px->roff[f - 1U];
+		/* deleted factors are never found */
+		const size_t p = qgidx_dead(idx, f)
+			? 0U : plen(px->roff[f] - px->roff[f - 1U], thr);
+
+		for (size_t i = 0U; i < p; i++) {
+			px->ppoff[r[i] + 1U]++;
+		}
+	}
+	for (size_t i = 1U; i <= nrank; i++) {
+		px->ppoff[i] += px->ppoff[i - 1U];
+	}
+	px->ppost = malloc((px->ppoff[nrank] ?: 1U) * sizeof(*px->ppost));
+	fill = malloc((nrank + 1U) * sizeof(*fill));
+	px->stamp = calloc(idx->nfactor + 1U, sizeof(*px->stamp));
+	if (UNLIKELY(px->ppost == NULL || fill == NULL || px->stamp == NULL)) {
+		free(fill);
+		goto nope;
+	}
+	memcpy(fill, px->ppoff, (nrank + 1U) * sizeof(*fill));
+	for (factor_t f = 1U; f <= idx->nfactor; f++) {
+		const uint32_t *r = px->rset + px->roff[f - 1U];
+		const size_t p = qgidx_dead(idx, f)
+			? 0U : plen(px->roff[f] - px->roff[f - 1U], thr);
+
+		for (size_t i = 0U; i < p; i++) {
+			px->ppost[fill[r[i]]++] = f;
+		}
+	}
+	free(fill);
+	return px;
+
+nope:
+	prefix_free(px);
+	return NULL;
+}
+
+size_t
+prefix_probe(prefix_t cpx, const char *s, size_t z, struct prefix_hit_s **hit)
+{
+	struct prefix_s *px = deconst(cpx);
+	const double thr = px->thr;
+	size_t nc = 0U, nh = 0U;
+
+	*hit = px->hit;
+	if (UNLIKELY(z < px->idx->q)) {
+		return 0U;
+	}
+
+	uint32_t r[z - px->idx->q + 1U];
+	size_t unk;
+	const size_t k = qset(px, s, z, r, &unk);
+	const size_t n = k + unk;
+	const size_t p = plen(n, thr);
+	/* length filter */
+	const size_t lo = atleast(thr * (double)n);
+	const size_t hi = (size_t)((double)n / thr + 1e-9);
+
+	px->nprobe++;
+	/* unknown qgrams are the rarest of all and come first */
+	for (size_t i = 0U; unk + i < p && i < k; i++) {
+		const factor_t *pp = px->ppost + px->ppoff[r[i]];
+		const factor_t *const ep = px->ppost + px->ppoff[r[i] + 1U];
+
+		px->nscan += ep - pp;
+		for (; pp < ep; pp++) {
+			const factor_t f = *pp;
+			const size_t m = px->roff[f] - px->roff[f - 1U];
+
+			if (m < lo || m > hi) {
+				continue;
+			} else if (px->stamp[f - 1U] == px->nprobe) {
+				continue;
+			}
+			px->stamp[f - 1U] = px->nprobe;
+			if (UNLIKELY(nc >= px->zcand)) {
+				px->zcand = (px->zcand * 2U) ?: 64U;
+				px->cand = realloc(px->cand, px->zcand *
+						   sizeof(*px->cand));
+			}
+			px->cand[nc++] = f;
+		}
+	}
+	px->ncand += nc;
+
+	/* verify */
+	for (size_t i = 0U; i < nc; i++) {
+		const factor_t f = px->cand[i];
+		const uint32_t *b = px->rset + px->roff[f - 1U];
+		const size_t m = px->roff[f] - px->roff[f - 1U];
+		const size_t o = overlap(r, k, b, m);
+		const double sim = (double)o / (double)(n + m - o);
+
+		if (sim < thr - 1e-9) {
+			continue;
+		}
+		if (UNLIKELY(nh >= px->zhit)) {
+			px->zhit = (px->zhit * 2U) ?: 16U;
+			px->hit = realloc(px->hit, px->zhit * sizeof(*px->hit));
+		}
+		px->hit[nh++] = (struct prefix_hit_s){f, o, sim};
+	}
+	if (nh > 1U) {
+		ford = px->idx->ford;
+		qsort(px->hit, nh, sizeof(*px->hit), cmp_hit);
+	}
+	*hit = px->hit;
+	return nh;
+}
+
+void
+prefix_stats(prefix_t px, size_t *nscan, size_t *ncand)
+{
+	*nscan = px->nscan;
+	*ncand = px->ncand;
+	return;
+}
+
+void
+prefix_free(prefix_t cpx)
+{
+	struct prefix_s *px = deconst(cpx);
+
+	free(px->rank);
+	free(px->roff);
+	free(px->rset);
+	free(px->ppoff);
+	free(px->ppost);
+	free(px->stamp);
+	free(px->cand);
+	free(px->hit);
+	free(px);
+	return;
+}
+
+/* prefix.c ends here */
@@ -0,0 +1,78 @@
+/*** prefix.h -- prefix filter join
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_prefix_h_
+#define INCLUDED_prefix_h_
+#include <stddef.h>
+#include "qgidx.h"
+
+/* The prefix filter (AllPairs/PPJoin) orders the distinct qgrams of
+ * every line by ascending document frequency.  Two lines whose qgram
+ * sets have a Jaccard similarity of at least T must then share one of
+ * the first n - ceil(T * n) + 1 qgrams of either line.  Only those
+ * prefixes are indexed and probed, survivors are verified. */
+typedef const struct prefix_s *prefix_t;
+
+struct prefix_hit_s {
+	/* the left factor */
+	factor_t f;
+	/* number of common qgrams and the Jaccard similarity */
+	size_t o;
+	double sim;
+};
+
+/**
+ * Build a prefix index over the factors of IDX for threshold THR.
+ * Document frequencies are taken from IDX, which must stay around. */
+extern prefix_t prefix_build(qgidx_t idx, double thr);
+
+/**
+ * Return the number of factors whose qgram sets have a Jaccard
+ * similarity of at least the threshold with S of length Z, and store
+ * them in *HIT, in input order.  *HIT is valid until the next call. */
+extern size_t
+prefix_probe(prefix_t px, const char *s, size_t z, struct prefix_hit_s **hit);
+
+/**
+ * Return the number of prefix postings walked and candidates verified
+ * in all probes so far, in *NSCAN and *NCAND. */
+extern void prefix_stats(prefix_t px, size_t *nscan, size_t *ncand);
+
+/**
+ * Free resources associated with PX. */
+extern void prefix_free(prefix_t px);
+
+#endif	/* INCLUDED_prefix_h_ */
@@ -0,0 +1,3513 @@
+/*** qgidx.c -- q-gram index
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "qgidx.h"
+#include "arena.h"
+#include "nifty.h"
+
+#define QGIDX_MAGIC	"QGIX"
+#define QGIDX_VERSION	16U
+/* sections in index files are aligned to this */
+#define QGIDX_ALIGN	4096U
+
+/* on-disk header */
+struct qgidx_hdr_s {
+	char magic[4U];
+	uint16_t version;
+	/* sizeof(size_t) of the writer */
+	uint8_t wordz;
+	uint8_t flags;
+	uint8_t q;
+	uint64_t nfactor;
+	uint64_t npool;
+	uint64_t ndir;
+	uint64_t nslot;
+	uint64_t npost;
+	uint64_t npack;
+	/* section offsets */
+	uint64_t opool;
+	uint64_t opoff;
+	uint64_t odir;
+	uint64_t oslot;
+	uint64_t opost;
+	/* 0 if there are no duplicates */
+	uint64_t omul;
+	/* 0 unless QGIDX_F_POS */
+	uint64_t opos;
+	/* 0 unless QGIDX_F_BYLEN or QGIDX_F_CLUSTER, NLBND is 0 unless
+	 * QGIDX_F_BYLEN */
+	uint64_t oford;
+	uint64_t olbnd;
+	uint64_t nlbnd;
+	/* 0 unless merged from shards, the section holds NSHARD + 1 bounds,
+	 * NSHARD name offsets and NSNAM bytes of names */
+	uint64_t oshard;
+	uint64_t nshard;
+	uint64_t nsnam;
+	/* tombstones, always there, NDEAD bits of them set */
+	uint64_t otomb;
+	uint64_t ndead;
+};
+
+struct _qgidx_s {
+	struct qgidx_s public;
+	/* non-NULL if mapped from a file */
+	void *map;
+	size_t mapz;
+	/* non-zero if just the pool is mapped */
+	int mpool;
+	/* regions behind the pool, offsets, multiplicities and postings
+	 * if the index was built */
+	struct arena_s apool, apoff, afmul;
+	struct arena_s apost, apack, apos;
+	/* factors decoded by `qgidx_unfront()' go here */
+	char *fbuf;
+	size_t zfbuf;
+};
+
+
+static void
+__attribute__((format(printf, 1, 2)))
+error(const char *fmt, ...)
+{
+	va_list vap;
+	va_start(vap, fmt);
+	vfprintf(stderr, fmt, vap);
+	va_end(vap);
+	if (errno) {
+		fputc(':', stderr);
+		fputc(' ', stderr);
+		fputs(strerror(errno), stderr);
+	}
+	fputc('\n', stderr);
+	return;
+}
+
+static inline size_t
+tombw(size_t n)
+{
+/* words of tombstones for N factors, with a spare word just like the
+ * candidate bitmaps of the probe so they can be masked word by word */
+	return n / 64U + 1U;
+}
+
+static inline void*
+diralloc(size_t n)
+{
+/* room for N directory entries, malloc() only aligns to 16 bytes but
+ * entries want a cache line half to themselves */
+	return aligned_alloc(__alignof__(struct qgdir_s),
+			     (n ?: 1U) * sizeof(struct qgdir_s));
+}
+
+/* symbol codes, -1 for separators which are condensed */
+static const int_fast8_t sym[256U] = {
+	[' '] = -1,
+	['-'] = -1,
+	['_'] = -1,
+	['0'] = 'O' - '@',
+	['1'] = 'I' - '@',
+	['2'] = 'Z' - '@',
+	['3'] = 27,
+	['4'] = 'A' - '@',
+	['5'] = 'S' - '@',
+	['6'] = 'G' - '@',
+	['7'] = 'T' - '@',
+	['8'] = 'B' - '@',
+	['9'] = 'Q' - '@',
+	['A'] = 'A' - '@',
+	['B'] = 'B' - '@',
+	['C'] = 'C' - '@',
+	['D'] = 'D' - '@',
+	['E'] = 'E' - '@',
+	['F'] = 'F' - '@',
+	['G'] = 'G' - '@',
+	['H'] = 'H' - '@',
+	['I'] = 'I' - '@',
+	['J'] = 'J' - '@',
+	['K'] = 'K' - '@',
+	['L'] = 'L' - '@',
+	['M'] = 'M' - '@',
+	['N'] = 'N' - '@',
+	['O'] = 'O' - '@',
+	['P'] = 'P' - '@',
+	['Q'] = 'Q' - '@',
+	['R'] = 'R' - '@',
+	['S'] = 'S' - '@',
+	['T'] = 'T' - '@',
+	['U'] = 'U' - '@',
+	['V'] = 'V' - '@',
+	['W'] = 'W' - '@',
+	['X'] = 'X' - '@',
+	['Y'] = 'Y' - '@',
+	['Z'] = 'Z' - '@',
+	['a'] = 'A' - '@',
+	['b'] = 'B' - '@',
+	['c'] = 'C' - '@',
+	['d'] = 'D' - '@',
+	['e'] = 'E' - '@',
+	['f'] = 'F' - '@',
+	['g'] = 'G' - '@',
+	['h'] = 'H' - '@',
+	['i'] = 'I' - '@',
+	['j'] = 'J' - '@',
+	['k'] = 'K' - '@',
+	['l'] = 'L' - '@',
+	['m'] = 'M' - '@',
+	['n'] = 'N' - '@',
+	['o'] = 'O' - '@',
+	['p'] = 'P' - '@',
+	['q'] = 'Q' - '@',
+	['r'] = 'R' - '@',
+	['s'] = 'S' - '@',
+	['t'] = 'T' - '@',
+	['u'] = 'U' - '@',
+	['v'] = 'V' - '@',
+	['w'] = 'W' - '@',
+	['x'] = 'X' - '@',
+	['y'] = 'Y' - '@',
+	['z'] = 'Z' - '@',
+};
+
+static inline __attribute__((always_inline)) size_t
+qgrams(qgram_t *restrict r, const char *s, size_t z,
+       const unsigned int q, const int exact)
+{
+/* generic kernel, only ever called with constant Q and EXACT,
+ * see QGRAMS(), legacy keys overlap adjacent symbols by one bit */
+	const unsigned int sh = exact ? 5U : 4U;
+	const qgram_t top = (qgram_t)0b11111U << sh * (q - 1U);
+	qgram_t x = 0U;
+	size_t n = 0U;
+	size_t condens;
+	size_t i, j;
+
+	for (i = 0U, j = 0U, condens = 1U; i < z && j < q; i++) {
+		const int_fast8_t h = sym[(unsigned char)s[i]];
+
+		if (h > 0 || !condens) {
+			x <<= sh;
+			x ^= h & 0b11111U;
+			j++;
+		}
+		condens = h < 0;
+	}
+	x &= ((qgram_t)1U << (exact ? QGRAM_XBITS(q) : QGRAM_BITS(q))) - 1U;
+	if (r) {
+		r[n] = x;
+	}
+	n += !!x;
+	/* keep going */
+	for (; i < z; i++) {
+		const int_fast8_t h = sym[(unsigned char)s[i]];
+
+		x ^= x & top;
+		if (h > 0 || !condens) {
+			x <<= sh;
+			x ^= h & 0b11111U;
+			j++;
+		}
+		condens = h < 0;
+		if (r) {
+			r[n] = x;
+		}
+		n += h > 0 || !condens;
+	}
+	return n;
+}
+
+/* instantiate a legacy and an exact kernel for every supported Q */
+#define QGRAMS(q)							\
+static size_t								\
+mkqgrams##q(qgram_t *restrict r, const char *s, size_t z)		\
+{									\
+	return qgrams(r, s, z, q##U, 0);				\
+}									\
+static size_t								\
+mkxgrams##q(qgram_t *restrict r, const char *s, size_t z)		\
+{									\
+	return qgrams(r, s, z, q##U, 1);				\
+}
+
+QGRAMS(3)
+QGRAMS(4)
+QGRAMS(5)
+QGRAMS(6)
+QGRAMS(7)
+QGRAMS(8)
+
+qgram_f
+qgidx_kernel(unsigned int q, unsigned int flags)
+{
+	static const qgram_f k[2U][QGRAM_MAX - QGRAM_MIN + 1U] = {
+		{
+			mkqgrams3, mkqgrams4, mkqgrams5,
+			mkqgrams6, mkqgrams7, mkqgrams8,
+		},
+		{
+			mkxgrams3, mkxgrams4, mkxgrams5,
+			mkxgrams6, mkxgrams7, mkxgrams8,
+		},
+	};
+
+	if (UNLIKELY(q < QGRAM_MIN || q > QGRAM_MAX)) {
+		return NULL;
+	}
+	return k[!!(flags & QGIDX_F_EXACT)][q - QGRAM_MIN];
+}
+
+
+/* qgram length, key width and kernel of the index being built */
+static unsigned int qlen;
+static unsigned int qbits;
+static qgram_f mkqg;
+
+static int
+setq(unsigned int q, unsigned int flags)
+{
+	if (UNLIKELY((mkqg = qgidx_kernel(q, flags)) == NULL)) {
+		errno = 0, error("\
+Error: qgram length %u not supported", q);
+		return -1;
+	}
+	qlen = q;
+	qbits = flags & QGIDX_F_EXACT ? QGRAM_XBITS(q) : QGRAM_BITS(q);
+	return 0;
+}
+
+static char *pool;
+static size_t npool;
+static factor_t ipool;
+static size_t *poff;
+/* POFF once Elias-Fano coded, see efpoff() */
+static struct qgef_s pef;
+/* set if POOL is a mapped file */
+static int mpool;
+/* multiplicity of factors */
+static uint32_t *fmul;
+/* regions behind POOL, POFF, FMUL and the postings */
+static struct arena_s apool, apoff, afmul;
+static struct arena_s apost, apack, apos;
+static size_t ndups;
+/* input order and qgram count bands if factors are ordered by length */
+static factor_t *ford;
+static size_t *lbnd;
+static size_t nlbnd;
+
+/* hash table of factors to find duplicates */
+struct dup_s {
+	uint_fast64_t h;
+	factor_t f;
+};
+static struct dup_s *dups;
+static size_t zdups;
+
+static inline uint_fast64_t
+strhash(const char *s, size_t z)
+{
+/* FNV-1a */
+	uint_fast64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0U; i < z; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static factor_t
+seen(const char *s, size_t z, uint_fast64_t h)
+{
+/* return the factor whose string is S of length Z, or 0 */
+	const size_t m = zdups - 1U;
+
+	if (UNLIKELY(!zdups)) {
+		return 0U;
+	}
+	for (size_t i = h & m; dups[i].f; i = (i + 1U) & m) {
+		const char *f = pool + poff[dups[i].f - 1U];
+
+		if (dups[i].h == h && (size_t)(pool + npool - f) >= z &&
+		    !memcmp(f, s, z) &&
+		    (f + z == pool + npool || f[z] == '\n')) {
+			return dups[i].f;
+		}
+	}
+	return 0U;
+}
+
+static void
+remember(factor_t f, uint_fast64_t h)
+{
+/* put F with string hash H into the duplicates table */
+	if (UNLIKELY(2U * f >= zdups)) {
+		const size_t nz = (zdups * 2U) ?: 1024U;
+		struct dup_s *nu = calloc(nz, sizeof(*nu));
+
+		for (size_t i = 0U; i < zdups; i++) {
+			if (dups[i].f) {
+				size_t j = dups[i].h & (nz - 1U);
+
+				for (; nu[j].f; j = (j + 1U) & (nz - 1U));
+				nu[j] = dups[i];
+			}
+		}
+		free(dups);
+		dups = nu;
+		zdups = nz;
+	}
+	for (size_t i = h & (zdups - 1U); ; i = (i + 1U) & (zdups - 1U)) {
+		if (!dups[i].f) {
+			dups[i] = (struct dup_s){h, f};
+			break;
+		}
+	}
+	return;
+}
+
+static inline int
+isdup(const char *s, size_t z, uint_fast64_t h)
+{
+/* check if S of length Z is a duplicate and count it if so */
+	const factor_t f = seen(s, z, h);
+
+	if (f) {
+		fmul[f - 1U]++;
+		ndups++;
+	}
+	return f > 0U;
+}
+
+static int
+growpoff(size_t n)
+{
+/* make room for N offsets and multiplicities */
+	if (UNLIKELY(n > (size_t)QGIDX_NFACTOR_MAX + 1U)) {
+		errno = 0, error("\
+Error: too many factors, at most %u are supported", QGIDX_NFACTOR_MAX);
+		return -1;
+	} else if (UNLIKELY((poff = arena_grow(
+				     &apoff, n * sizeof(*poff))) == NULL ||
+			    (fmul = arena_grow(
+				     &afmul, n * sizeof(*fmul))) == NULL)) {
+		errno = 0, error("\
+Error: cannot allocate factor offsets");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+intern(const char *str, size_t len)
+{
+	const uint_fast64_t h = strhash(str, len);
+
+	if (isdup(str, len, h)) {
+		return 0;
+	} else if (UNLIKELY((pool = arena_grow(&apool, npool + len + 1U)) ==
+			    NULL)) {
+		errno = 0, error("\
+Error: cannot allocate pool");
+		return -1;
+	} else if (UNLIKELY(growpoff((size_t)ipool + 2U) < 0)) {
+		return -1;
+	}
+	/* copy */
+	memcpy(pool + npool, str, len);
+	npool += len;
+	pool[npool++] = '\n';
+
+	fmul[ipool] = 1U;
+	poff[++ipool] = npool;
+	remember(ipool, h);
+	return 0;
+}
+
+static int
+mappool(int fd)
+{
+/* use the file behind FD as pool, just record where its lines start,
+ * return -1 if FD cannot be mapped and -2 on allocation failure */
+	struct stat st;
+	void *map;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	pool = map;
+	npool = st.st_size;
+	mpool = 1;
+
+	for (const char *s = pool, *const ep = pool + npool, *e; s < ep;
+	     s = e + 1U) {
+		/* memchr() is vectorised in every libc we care about */
+		if ((e = memchr(s, '\n', ep - s)) == NULL) {
+			e = ep;
+		}
+		uint_fast64_t h;
+
+		if (UNLIKELY((size_t)(e - s) < qlen)) {
+			continue;
+		} else if (isdup(s, e - s, h = strhash(s, e - s))) {
+			continue;
+		}
+		if (UNLIKELY(growpoff((size_t)ipool + 2U) < 0)) {
+			return -2;
+		}
+		fmul[ipool] = 1U;
+		poff[ipool++] = s - pool;
+		remember(ipool, h);
+	}
+	if (UNLIKELY(growpoff((size_t)ipool + 1U) < 0)) {
+		return -2;
+	}
+	poff[ipool] = npool;
+	return 0;
+}
+
+static inline const char*
+factor(factor_t f, size_t *z)
+{
+	const char *s = pool + poff[f - 1U];
+	const char *e = memchr(s, '\n', poff[f] - poff[f - 1U]);
+
+	*z = e ? (size_t)(e - s) : poff[f] - poff[f - 1U];
+	return s;
+}
+
+static size_t
+pack128(uint32_t *restrict tgt, const factor_t *src, uint32_t prev[static 4U])
+{
+/* delta-encode and bit-pack 128 ids from SRC into TGT, see unpack128() */
+	uint32_t d[128U];
+	uint32_t all = 0U;
+	unsigned int b;
+
+	for (size_t i = 0U; i < 128U; i++) {
+		d[i] = (uint32_t)src[i] - prev[i % 4U];
+		prev[i % 4U] = (uint32_t)src[i];
+		all |= d[i];
+	}
+	b = all ? 32U - __builtin_clz(all) : 0U;
+	tgt[0U] = b;
+	memset(tgt + 1U, 0, 4U * b * sizeof(*tgt));
+	for (size_t i = 0U; i < 128U; i++) {
+		const size_t bit = i / 4U * b;
+		const size_t w = 1U + 4U * (bit / 32U) + i % 4U;
+		const size_t sh = bit % 32U;
+
+		tgt[w] |= d[i] << sh;
+		if (sh + b > 32U) {
+			tgt[w + 4U] |= d[i] >> (32U - sh);
+		}
+	}
+	return 1U + 4U * b;
+}
+
+static size_t
+pack1(uint32_t *restrict tgt, const factor_t *p, size_t n)
+{
+/* pack the N ids P into TGT, return the number of words used */
+	uint32_t prev[4U];
+	size_t r = 0U;
+
+	tgt[r++] = prev[0U] = prev[1U] = prev[2U] = prev[3U] = p[0U];
+	for (size_t j = 0U; j + 128U <= n; j += 128U) {
+		r += pack128(tgt + r, p + j, prev);
+	}
+	if (n % 128U) {
+		/* pad by repeating the last id */
+		factor_t tail[128U];
+		size_t j = n - n % 128U;
+
+		memcpy(tail, p + j, (n - j) * sizeof(*p));
+		for (j = n - j; j < countof(tail); j++) {
+			tail[j] = p[n - 1U];
+		}
+		r += pack128(tgt + r, tail, prev);
+	}
+	return r;
+}
+
+static void
+unpack1(factor_t *restrict tgt, const uint32_t *p, size_t n)
+{
+/* unpack the N ids packed in P into TGT */
+	v4u_t prev = {*p, *p, *p, *p};
+
+	p++;
+	for (size_t j = 0U; j < n; j += 128U) {
+		uint32_t b[128U];
+		const size_t m = n - j < 128U ? n - j : 128U;
+
+		p += unpack128(b, p, &prev);
+		for (size_t l = 0U; l < m; l++) {
+			tgt[j + l] = b[l];
+		}
+	}
+	return;
+}
+
+static size_t
+pklen(const uint32_t *p, size_t n)
+{
+/* return the number of words of the N ids packed in P */
+	size_t r = 1U;
+
+	for (size_t j = 0U; j < n; j += 128U) {
+		r += 1U + 4U * p[r];
+	}
+	return r;
+}
+
+static inline size_t
+pkmax(size_t n)
+{
+/* worst case is 32 bits per id plus the block and list headers */
+	return 1U + (n + 127U) / 128U * 129U;
+}
+
+static size_t
+roar1(uint32_t *restrict tgt, const factor_t *p, size_t n)
+{
+/* store the N ascending ids P as roaring containers in TGT, picking
+ * whichever of array, bitmap or runs is smallest, return the number
+ * of words used, see roarlen() */
+	size_t r = 1U;
+
+	tgt[0U] = 0U;
+	for (size_t i = 0U, j; i < n; i = j) {
+		const uint32_t key = (uint32_t)(p[i] - 1U) >> 16U;
+		uint32_t *c = tgt + r;
+		uint32_t *v = c + 2U;
+		size_t card = 0U, nrun = 0U, narr;
+		uint32_t last = 0U;
+
+		/* count distinct ids and runs of this container */
+		for (j = i; j < n && (uint32_t)(p[j] - 1U) >> 16U == key; j++) {
+			const uint32_t x = (uint32_t)(p[j] - 1U) & 0xffffU;
+
+			if (card && x == last) {
+				continue;
+			}
+			nrun += !card || x != last + 1U;
+			card++;
+			last = x;
+		}
+		narr = (card + 1U) / 2U;
+
+		if (nrun < narr && nrun < QGROAR_BMW) {
+			size_t k = 0U;
+
+			c[0U] = key << 16U | QGROAR_RUN;
+			c[1U] = (uint32_t)nrun;
+			for (size_t l = i; l < j; l++) {
+				const uint32_t x =
+					(uint32_t)(p[l] - 1U) & 0xffffU;
+
+				if (l == i || x > last + 1U) {
+					/* new run */
+					v[k++] = x;
+				} else {
+					v[k - 1U] = (v[k - 1U] & 0xffffU) |
+						(x - (v[k - 1U] & 0xffffU))
+						<< 16U;
+				}
+				last = x;
+			}
+			r += 2U + nrun;
+		} else if (narr <= QGROAR_BMW) {
+			size_t k = 0U;
+
+			c[0U] = key << 16U | QGROAR_ARRAY;
+			c[1U] = (uint32_t)card;
+			for (size_t l = i; l < j; l++) {
+				const uint32_t x =
+					(uint32_t)(p[l] - 1U) & 0xffffU;
+
+				if (l > i && x == last) {
+					continue;
+				} else if (k % 2U) {
+					v[k / 2U] |= x << 16U;
+				} else {
+					v[k / 2U] = x;
+				}
+				last = x;
+				k++;
+			}
+			r += 2U + narr;
+		} else {
+			c[0U] = key << 16U | QGROAR_BITMAP;
+			c[1U] = (uint32_t)card;
+			memset(v, 0, QGROAR_BMW * sizeof(*v));
+			for (size_t l = i; l < j; l++) {
+				const uint32_t x =
+					(uint32_t)(p[l] - 1U) & 0xffffU;
+
+				v[x / 32U] |= 1U << x % 32U;
+			}
+			r += 2U + QGROAR_BMW;
+		}
+		tgt[0U]++;
+	}
+	return r;
+}
+
+static size_t
+unroar1(factor_t *restrict tgt, const uint32_t *p)
+{
+/* decode the roaring containers at P into TGT, return the number of
+ * ids, which are distinct */
+	const size_t nc = *p++;
+	size_t n = 0U;
+
+	for (size_t i = 0U; i < nc; i++, p += roarlen(p)) {
+		const factor_t base = (factor_t)((p[0U] >> 16U) << 16U) + 1U;
+		const uint32_t *v = p + 2U;
+
+		if ((p[0U] & 0xffffU) == QGROAR_ARRAY) {
+			for (size_t k = 0U; k < p[1U]; k++) {
+				tgt[n++] = base +
+					(v[k / 2U] >> 16U * (k % 2U) & 0xffffU);
+			}
+		} else if ((p[0U] & 0xffffU) == QGROAR_BITMAP) {
+			for (size_t k = 0U; k < QGROAR_BMW; k++) {
+				for (uint32_t b = v[k]; b; b &= b - 1U) {
+					tgt[n++] = base + 32U * k +
+						__builtin_ctz(b);
+				}
+			}
+		} else {
+			for (size_t k = 0U; k < p[1U]; k++) {
+				const factor_t s = base + (v[k] & 0xffffU);
+				const factor_t e = s + (v[k] >> 16U);
+
+				for (factor_t f = s; f <= e; f++) {
+					tgt[n++] = f;
+				}
+			}
+		}
+	}
+	return n;
+}
+
+static size_t
+rolen(const uint32_t *p)
+{
+/* return the number of words of the roaring containers at P */
+	size_t r = 1U;
+
+	for (size_t i = 0U; i < *p; i++) {
+		r += roarlen(p + r);
+	}
+	return r;
+}
+
+static inline size_t
+romax(size_t n)
+{
+/* worst case is an array container for every id */
+	return 1U + 3U * n;
+}
+
+static uint32_t*
+mkpack(struct qgdir_s *restrict ent, size_t nent,
+       const factor_t *post, size_t *npack, struct arena_s *a,
+       unsigned int flags)
+{
+/* pack the posting lists of the NENT directory entries ENT into A,
+ * or into malloc()ed memory if A is NULL, rewrite their offsets to
+ * point into the result, as roaring containers if FLAGS has
+ * QGIDX_F_ROAR */
+	const int roar = !!(flags & QGIDX_F_ROAR);
+	uint32_t *res;
+	size_t nres = 0U;
+
+	for (size_t i = 0U; i < nent; i++) {
+		nres += roar ? romax(ent[i].n) : pkmax(ent[i].n);
+	}
+	if (a != NULL) {
+		res = arena_grow(a, (nres ?: 1U) * sizeof(*res));
+	} else {
+		res = malloc((nres ?: 1U) * sizeof(*res));
+	}
+	if (UNLIKELY(res == NULL)) {
+		return NULL;
+	}
+	nres = 0U;
+	for (size_t i = 0U; i < nent; i++) {
+		const size_t off = ent[i].off;
+
+		ent[i].off = nres;
+		nres += roar
+			? roar1(res + nres, post + off, ent[i].n)
+			: pack1(res + nres, post + off, ent[i].n);
+	}
+	*npack = nres;
+	if (a != NULL) {
+		arena_trim(a, (nres ?: 1U) * sizeof(*res));
+		return res;
+	}
+	return realloc(res, (nres ?: 1U) * sizeof(*res));
+}
+
+
+/* reordering
+ * With QGIDX_F_BYLEN factors are renumbered by ascending qgram count,
+ * ties keep input order.  With QGIDX_F_CLUSTER factors (of the same
+ * qgram count) are renumbered by a minhash signature instead, so that
+ * factors sharing qgrams get nearby ids and a query's hits land on
+ * fewer cache lines of the accumulators.  The pool is rewritten in the
+ * new order so that POFF stays monotonic. */
+static uint_fast64_t *fsig;
+
+static uint_fast64_t
+minhash(const char *s, size_t z)
+{
+/* smallest qgram hash of S in the upper half, and the smallest
+ * under another hash in the lower half to break ties */
+	qgram_t x[z >= qlen ? z - qlen + 1U : 1U];
+	const size_t m = mkqg(x, s, z);
+	uint_fast64_t a = -1ULL, b = -1ULL;
+
+	for (size_t i = 0U; i < m; i++) {
+		const uint_fast64_t h = qghash(x[i]);
+		const uint_fast64_t g = qghash(~x[i]);
+
+		a = h < a ? h : a;
+		b = g < b ? g : b;
+	}
+	return (a & 0xffffffff00000000ULL) | b >> 32U;
+}
+
+static int
+cmp_sig(const void *x, const void *y)
+{
+	const factor_t f = *(const factor_t*)x;
+	const factor_t g = *(const factor_t*)y;
+	const uint_fast64_t a = fsig[f - 1U];
+	const uint_fast64_t b = fsig[g - 1U];
+
+	if (a != b) {
+		return (a > b) - (a < b);
+	}
+	return (f > g) - (f < g);
+}
+
+static int
+reorder(unsigned int flags)
+{
+	size_t *cnt, *nu;
+	size_t maxc = 0U, z = 0U;
+	struct arena_s bpool = {NULL}, bpoff = {NULL}, bfmul = {NULL};
+	char *npl;
+	size_t *npo;
+	uint32_t *nmu;
+
+	if (UNLIKELY((cnt = malloc((ipool ?: 1U) * sizeof(*cnt))) == NULL)) {
+		return -1;
+	} else if ((flags & QGIDX_F_CLUSTER) &&
+		   UNLIKELY((fsig = malloc((ipool ?: 1U) *
+					   sizeof(*fsig))) == NULL)) {
+		free(cnt);
+		return -1;
+	}
+	for (factor_t f = 1U; f <= ipool; f++) {
+		size_t fz;
+		const char *s = factor(f, &fz);
+
+		/* without length bands everything is one band */
+		cnt[f - 1U] = flags & QGIDX_F_BYLEN ? mkqg(NULL, s, fz) : 0U;
+		if (cnt[f - 1U] > maxc) {
+			maxc = cnt[f - 1U];
+		}
+		if (fsig != NULL) {
+			fsig[f - 1U] = minhash(s, fz);
+		}
+		z += fz + 1U;
+	}
+	nlbnd = maxc + 2U;
+	lbnd = calloc(nlbnd, sizeof(*lbnd));
+	ford = malloc((ipool ?: 1U) * sizeof(*ford));
+	nu = malloc(nlbnd * sizeof(*nu));
+	npl = arena_grow(&bpool, (z ?: 1U) * sizeof(*npl));
+	npo = arena_grow(&bpoff, (ipool + 1U) * sizeof(*npo));
+	nmu = arena_grow(&bfmul, (ipool + 1U) * sizeof(*nmu));
+	if (UNLIKELY(lbnd == NULL || ford == NULL || nu == NULL ||
+		     npl == NULL || npo == NULL || nmu == NULL)) {
+		free(cnt);
+		free(fsig);
+		fsig = NULL;
+		free(nu);
+		arena_fini(&bpool);
+		arena_fini(&bpoff);
+		arena_fini(&bfmul);
+		free(lbnd);
+		free(ford);
+		lbnd = NULL, ford = NULL;
+		return -1;
+	}
+	/* counting sort, LBND[C] is the first factor with C qgrams or more */
+	for (factor_t f = 0U; f < ipool; f++) {
+		lbnd[cnt[f] + 1U]++;
+	}
+	lbnd[0U] = 1U;
+	for (size_t c = 1U; c < nlbnd; c++) {
+		lbnd[c] += lbnd[c - 1U];
+	}
+	memcpy(nu, lbnd, (ipool ? maxc + 1U : 0U) * sizeof(*nu));
+	for (factor_t f = 1U; f <= ipool; f++) {
+		ford[nu[cnt[f - 1U]]++ - 1U] = f;
+	}
+	if (fsig != NULL) {
+		/* cluster within bands */
+		for (size_t c = 0U; c <= maxc && ipool; c++) {
+			qsort(ford + lbnd[c] - 1U, lbnd[c + 1U] - lbnd[c],
+			      sizeof(*ford), cmp_sig);
+		}
+		free(fsig);
+		fsig = NULL;
+	}
+	if (!(flags & QGIDX_F_BYLEN)) {
+		/* just the one band */
+		free(lbnd);
+		lbnd = NULL;
+		nlbnd = 0U;
+	}
+	/* rewrite pool */
+	npo[0U] = 0U;
+	for (factor_t f = 1U; f <= ipool; f++) {
+		size_t fz;
+		const char *s = factor(ford[f - 1U], &fz);
+
+		memcpy(npl + npo[f - 1U], s, fz);
+		npl[npo[f - 1U] + fz] = '\n';
+		npo[f] = npo[f - 1U] + fz + 1U;
+		nmu[f - 1U] = fmul[ford[f - 1U] - 1U];
+	}
+	if (mpool) {
+		munmap(pool, npool);
+	}
+	arena_fini(&apool);
+	arena_fini(&apoff);
+	arena_fini(&afmul);
+	free(cnt);
+	free(nu);
+	pool = npl;
+	npool = z;
+	poff = npo;
+	fmul = nmu;
+	apool = bpool;
+	apoff = bpoff;
+	afmul = bfmul;
+	mpool = 0;
+	return 0;
+}
+
+
+/* front coding
+ * Factors are grouped in blocks of QGIDX_FRONT_BLK.  The first factor
+ * of a block is stored as its length followed by its bytes, the others
+ * as the length of the prefix shared with their predecessor, the length
+ * of the rest and the rest.  Lengths are LEB128 varints. */
+static inline size_t
+putv(unsigned char *restrict p, size_t v)
+{
+	size_t n = 0U;
+
+	for (; v >= 0x80U; v >>= 7U) {
+		p[n++] = (unsigned char)(v | 0x80U);
+	}
+	p[n++] = (unsigned char)v;
+	return n;
+}
+
+static inline size_t
+getv(const unsigned char *p, size_t *v)
+{
+	size_t n = 0U, r = 0U;
+
+	do {
+		r |= (size_t)(p[n] & 0x7fU) << (7U * n);
+	} while (p[n++] & 0x80U);
+	*v = r;
+	return n;
+}
+
+static size_t
+eflayout(struct qgef_s *e, size_t n, size_t u, const uint64_t *base)
+{
+/* lay out the Elias-Fano code of N ascending values below U at BASE,
+ * low bits first, then the unary high bits, then the select samples,
+ * return the number of words */
+	const unsigned int l = u > n
+		? 63U - (unsigned int)__builtin_clzll(u / n) : 0U;
+	const size_t nlo = (n * l + 63U) / 64U + 1U;
+	const size_t nhi = ((u >> l) + n + 63U) / 64U + 1U;
+	const size_t nsel = (n + QGEF_SAMPLE - 1U) / QGEF_SAMPLE;
+
+	*e = (struct qgef_s){.n = n, .l = l};
+	if (base != NULL) {
+		e->lo = base;
+		e->hi = base + nlo;
+		e->sel = (const void*)(base + nlo + nhi);
+	}
+	return nlo + nhi + (nsel * sizeof(*e->sel) + 7U) / 8U;
+}
+
+static void
+efset(uint64_t *restrict w, const struct qgef_s *e, size_t i, size_t v)
+{
+/* set value I of E, laid out at W, to V */
+	uint64_t *hi = w + (e->hi - e->lo);
+	size_t *sel = (void*)((char*)w +
+			      ((const char*)e->sel - (const char*)w));
+	const size_t h = (v >> e->l) + i;
+
+	hi[h / 64U] |= 1ULL << (h % 64U);
+	if (i % QGEF_SAMPLE == 0U) {
+		sel[i / QGEF_SAMPLE] = h;
+	}
+	if (e->l) {
+		const uint64_t x = v & ((1ULL << e->l) - 1U);
+		const size_t b = i * e->l;
+
+		w[b / 64U] |= x << (b % 64U);
+		if (b % 64U + e->l > 64U) {
+			w[b / 64U + 1U] |= x >> (64U - b % 64U);
+		}
+	}
+	return;
+}
+
+static int
+efpoff(void)
+{
+/* Elias-Fano code POFF, offsets take about log2(NPOOL / NFACTOR) + 2
+ * bits each instead of a whole word */
+	struct arena_s bef = {NULL};
+	const size_t n = ipool + 1U;
+	const size_t nw = eflayout(&pef, n, npool, NULL);
+	uint64_t *w = arena_grow(&bef, nw * sizeof(*w));
+
+	if (UNLIKELY(w == NULL)) {
+		return -1;
+	}
+	eflayout(&pef, n, npool, w);
+	for (size_t i = 0U; i < n; i++) {
+		efset(w, &pef, i, poff[i]);
+	}
+	arena_fini(&apoff);
+	apoff = bef;
+	poff = NULL;
+	return 0;
+}
+
+static int
+front(void)
+{
+/* front-code the pool, POOL and POFF are then the coded blocks and
+ * the block offsets respectively */
+	struct arena_s bpool = {NULL}, bblk = {NULL};
+	const size_t nblk = (ipool + QGIDX_FRONT_BLK - 1U) / QGIDX_FRONT_BLK;
+	unsigned char *p = arena_grow(&bpool, 1U);
+	size_t *blk = arena_grow(&bblk, (nblk + 1U) * sizeof(*blk));
+	const char *prev = NULL;
+	size_t nprev = 0U;
+	size_t n = 0U;
+
+	if (UNLIKELY(p == NULL || blk == NULL)) {
+		goto nope;
+	}
+	for (factor_t f = 1U; f <= ipool; f++) {
+		size_t z, k = 0U;
+		const char *s = factor(f, &z);
+
+		/* two varints at most, then the rest */
+		if (UNLIKELY((p = arena_grow(&bpool, n + 2U * 10U + z)) ==
+			     NULL)) {
+			goto nope;
+		} else if ((f - 1U) % QGIDX_FRONT_BLK == 0U) {
+			/* restart */
+			blk[(f - 1U) / QGIDX_FRONT_BLK] = n;
+		} else {
+			for (; k < z && k < nprev && s[k] == prev[k]; k++);
+			n += putv(p + n, k);
+		}
+		n += putv(p + n, z - k);
+		memcpy(p + n, s + k, z - k);
+		n += z - k;
+		prev = s, nprev = z;
+	}
+	blk[nblk] = n;
+	arena_trim(&bpool, n ?: 1U);
+
+	if (mpool) {
+		munmap(pool, npool);
+	}
+	arena_fini(&apool);
+	arena_fini(&apoff);
+	pool = (char*)p;
+	npool = n;
+	poff = blk;
+	apool = bpool;
+	apoff = bblk;
+	mpool = 0;
+	return 0;
+
+nope:
+	arena_fini(&bpool);
+	arena_fini(&bblk);
+	return -1;
+}
+
+const char*
+qgidx_unpool(qgidx_t idx, factor_t f, size_t *len)
+{
+	/* neighbouring values share the select work */
+	const size_t p = qgef_sel(&idx->poff, f - 1U);
+	const size_t a = (p - (f - 1U)) << idx->poff.l |
+		qgef_lo(&idx->poff, f - 1U);
+	const size_t b = (qgef_next(&idx->poff, p) - f) << idx->poff.l |
+		qgef_lo(&idx->poff, f);
+	const char *s = idx->pool + a;
+	const size_t z = b - a;
+	const char *e = memchr(s, '\n', z);
+
+	*len = e ? (size_t)(e - s) : z;
+	return s;
+}
+
+const char*
+qgidx_unfront(qgidx_t idx, factor_t f, size_t *len)
+{
+	struct _qgidx_s *_idx = deconst(idx);
+	const unsigned char *p =
+		idx->fpool + idx->fblk[(f - 1U) / QGIDX_FRONT_BLK];
+	size_t z = 0U;
+
+	for (size_t i = 0U; i <= (f - 1U) % QGIDX_FRONT_BLK; i++) {
+		size_t k = 0U, r;
+
+		if (i) {
+			p += getv(p, &k);
+		}
+		p += getv(p, &r);
+		if (UNLIKELY(k + r > _idx->zfbuf)) {
+			const size_t nz = k + r > 2U * _idx->zfbuf
+				? k + r + 256U : 2U * _idx->zfbuf;
+			char *nu = realloc(_idx->fbuf, nz);
+
+			if (UNLIKELY(nu == NULL)) {
+				*len = 0U;
+				return "";
+			}
+			_idx->fbuf = nu;
+			_idx->zfbuf = nz;
+		}
+		memcpy(_idx->fbuf + k, p, r);
+		p += r;
+		z = k + r;
+	}
+	*len = z;
+	return _idx->fbuf;
+}
+
+
+/* directory building
+ * Qgrams are counted in a growing hash table first.  The distinct
+ * qgrams are then sorted and their postings laid out in key order. */
+struct cnt_s {
+	struct qgdir_s *tbl;
+	size_t ztbl;
+	size_t nkey;
+};
+
+static inline size_t
+slot(const struct qgdir_s *tbl, size_t ztbl, qgram_t key)
+{
+/* return the slot of KEY in TBL, or the empty slot it would go into */
+	const size_t m = ztbl - 1U;
+	size_t i;
+
+	for (i = qghash(key) & m; tbl[i].n && tbl[i].key != key;
+	     i = (i + 1U) & m);
+	return i;
+}
+
+static int
+cnt_grow(struct cnt_s *c)
+{
+	const size_t nz = (c->ztbl * 2U) ?: 1024U;
+	struct qgdir_s *nu;
+
+	if (UNLIKELY((nu = diralloc(nz)) == NULL)) {
+		return -1;
+	}
+	memset(nu, 0, nz * sizeof(*nu));
+	for (size_t i = 0U; i < c->ztbl; i++) {
+		if (c->tbl[i].n) {
+			nu[slot(nu, nz, c->tbl[i].key)] = c->tbl[i];
+		}
+	}
+	free(c->tbl);
+	c->tbl = nu;
+	c->ztbl = nz;
+	return 0;
+}
+
+static inline int
+cnt_bump(struct cnt_s *c, qgram_t key)
+{
+	size_t i;
+
+	if (UNLIKELY(2U * c->nkey >= c->ztbl) && UNLIKELY(cnt_grow(c) < 0)) {
+		return -1;
+	}
+	i = slot(c->tbl, c->ztbl, key);
+	c->nkey += !c->tbl[i].n;
+	c->tbl[i].key = key;
+	c->tbl[i].n++;
+	return 0;
+}
+
+static inline size_t
+cnt_fill(struct cnt_s *c, qgram_t key)
+{
+/* return the offset of the next free posting of KEY, after cnt_layout() */
+	return c->tbl[slot(c->tbl, c->ztbl, key)].off++;
+}
+
+static int
+cmp_key(const void *x, const void *y)
+{
+	const struct qgdir_s *a = x, *b = y;
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+static struct qgdir_s*
+cnt_layout(struct cnt_s *c, size_t base, size_t *nent)
+{
+/* return the counted qgrams as array sorted by key with posting offsets
+ * starting at BASE, the table's offsets become fill pointers */
+	struct qgdir_s *ent;
+	size_t n = 0U;
+
+	if (UNLIKELY((ent = diralloc(c->nkey)) == NULL)) {
+		return NULL;
+	}
+	for (size_t i = 0U; i < c->ztbl; i++) {
+		if (c->tbl[i].n) {
+			ent[n++] = c->tbl[i];
+		}
+	}
+	qsort(ent, n, sizeof(*ent), cmp_key);
+	for (size_t i = 0U; i < n; i++) {
+		ent[i].off = base;
+		c->tbl[slot(c->tbl, c->ztbl, ent[i].key)].off = base;
+		base += ent[i].n;
+	}
+	*nent = n;
+	return ent;
+}
+
+static factor_t*
+mkpost(struct qgdir_s **ent, size_t *nent, size_t *npost, factor_t from,
+       uint8_t **pos, struct arena_s *ap, struct arena_s *app)
+{
+/* count postings per qgram of factors FROM onwards first,
+ * then fill them into one array in AP, and their positions into *POS
+ * in APP unless POS is NULL */
+	struct cnt_s c = {NULL};
+	factor_t *post = NULL;
+	uint8_t *pp = NULL;
+	size_t n = 0U;
+
+	/* pass 1, count */
+	for (factor_t f = from; f <= ipool; f++) {
+		size_t z;
+		const char *s = factor(f, &z);
+		qgram_t x[z - qlen + 1U];
+		const size_t m = mkqg(x, s, z);
+
+		for (size_t i = 0U; i < m; i++) {
+			if (UNLIKELY(cnt_bump(&c, x[i]) < 0)) {
+				goto out;
+			}
+		}
+	}
+	if (UNLIKELY((*ent = cnt_layout(&c, 0U, nent)) == NULL)) {
+		goto out;
+	}
+	for (size_t i = 0U; i < *nent; i++) {
+		n += (*ent)[i].n;
+	}
+	if (UNLIKELY((post = arena_grow(ap, (n ?: 1U) * sizeof(*post))) ==
+		     NULL)) {
+		free(*ent);
+		goto out;
+	} else if (pos != NULL &&
+		   UNLIKELY((pp = arena_grow(app, (n ?: 1U) * sizeof(*pp))) ==
+			    NULL)) {
+		free(*ent);
+		arena_fini(ap);
+		post = NULL;
+		goto out;
+	}
+	/* pass 2, fill */
+	for (factor_t f = from; f <= ipool; f++) {
+		size_t z;
+		const char *s = factor(f, &z);
+		qgram_t x[z - qlen + 1U];
+		const size_t m = mkqg(x, s, z);
+
+		for (size_t i = 0U; i < m; i++) {
+			const size_t o = cnt_fill(&c, x[i]);
+
+			post[o] = f;
+			if (pp != NULL) {
+				pp[o] = i < QGIDX_POS_MAX ? i : QGIDX_POS_MAX;
+			}
+		}
+	}
+	*npost = n;
+	if (pos != NULL) {
+		*pos = pp;
+	}
+out:
+	free(c.tbl);
+	return post;
+}
+
+
+/* parallel building
+ * The pool is split into NTHR byte ranges of whole factors.  Each range
+ * is turned into (qgram, factor) pairs bucketed by qgram partition.
+ * Partitions are then counted, filled and packed independently,
+ * visiting the buckets in range order so that posting lists stay
+ * ascending and everything comes out exactly as in the serial case. */
+#define NPART		64U
+#define PART(h)		((h) >> (qbits - 6U))
+
+struct pair_s {
+	qgram_t h;
+	factor_t f;
+};
+
+struct bld_s {
+	unsigned int flags;
+	unsigned int nthr;
+	factor_t *post;
+	/* factor range of extraction thread T is FRNG[T] to FRNG[T + 1] */
+	factor_t *frng;
+	/* pairs of thread T and partition P are
+	 * PAIRS[T][BKT[T][P]] to PAIRS[T][BKT[T][P + 1]] */
+	struct pair_s **pairs;
+	/* positions of the pairs if QGIDX_F_POS */
+	uint8_t **ppos;
+	uint8_t *pos;
+	size_t (*bkt)[NPART + 1U];
+	/* offset of partition P in POST */
+	size_t base[NPART + 1U];
+	/* directory entries of partition P */
+	struct qgdir_s *ent[NPART];
+	size_t nent[NPART];
+	/* packed partitions */
+	uint32_t *pack[NPART];
+	size_t npack[NPART];
+	/* next partition to distribute */
+	unsigned int next;
+	int rc;
+};
+
+struct wrk_s {
+	struct bld_s *b;
+	unsigned int t;
+};
+
+static void*
+extract(void *clo)
+{
+	const struct wrk_s *w = clo;
+	struct bld_s *b = w->b;
+	const factor_t lo = b->frng[w->t], hi = b->frng[w->t + 1U];
+	size_t *bkt = b->bkt[w->t];
+	struct pair_s *pairs;
+	uint8_t *pp = NULL;
+
+	memset(bkt, 0, sizeof(b->bkt[w->t]));
+	/* pass 1, count */
+	for (factor_t f = lo; f < hi; f++) {
+		size_t z;
+		const char *s = factor(f, &z);
+		qgram_t x[z - qlen + 1U];
+		const size_t m = mkqg(x, s, z);
+
+		for (size_t i = 0U; i < m; i++) {
+			bkt[PART(x[i]) + 1U]++;
+		}
+	}
+	for (size_t p = 1U; p <= NPART; p++) {
+		bkt[p] += bkt[p - 1U];
+	}
+	if (UNLIKELY((pairs = malloc((bkt[NPART] ?: 1U) *
+				     sizeof(*pairs))) == NULL)) {
+		b->rc = -1;
+		return NULL;
+	} else if (b->ppos != NULL &&
+		   UNLIKELY((pp = malloc(bkt[NPART] ?: 1U)) == NULL)) {
+		free(pairs);
+		b->rc = -1;
+		return NULL;
+	}
+	/* pass 2, fill, BKT[P] is used as fill pointer */
+	for (factor_t f = lo; f < hi; f++) {
+		size_t z;
+		const char *s = factor(f, &z);
+		qgram_t x[z - qlen + 1U];
+		const size_t m = mkqg(x, s, z);
+
+		for (size_t i = 0U; i < m; i++) {
+			const size_t o = bkt[PART(x[i])]++;
+
+			pairs[o] = (struct pair_s){x[i], f};
+			if (pp != NULL) {
+				pp[o] = i < QGIDX_POS_MAX ? i : QGIDX_POS_MAX;
+			}
+		}
+	}
+	/* restore bucket offsets */
+	memmove(bkt + 1U, bkt, NPART * sizeof(*bkt));
+	bkt[0U] = 0U;
+	b->pairs[w->t] = pairs;
+	if (pp != NULL) {
+		b->ppos[w->t] = pp;
+	}
+	return NULL;
+}
+
+static int
+distpart(struct bld_s *b, unsigned int p)
+{
+	struct cnt_s c = {NULL};
+
+	/* count */
+	for (unsigned int t = 0U; t < b->nthr; t++) {
+		const struct pair_s *x = b->pairs[t];
+
+		for (size_t i = b->bkt[t][p]; i < b->bkt[t][p + 1U]; i++) {
+			if (UNLIKELY(cnt_bump(&c, x[i].h) < 0)) {
+				goto nope;
+			}
+		}
+	}
+	/* offsets */
+	b->ent[p] = cnt_layout(&c, b->base[p], b->nent + p);
+	if (UNLIKELY(b->ent[p] == NULL)) {
+		goto nope;
+	}
+	/* fill */
+	for (unsigned int t = 0U; t < b->nthr; t++) {
+		const struct pair_s *x = b->pairs[t];
+
+		for (size_t i = b->bkt[t][p]; i < b->bkt[t][p + 1U]; i++) {
+			const size_t o = cnt_fill(&c, x[i].h);
+
+			b->post[o] = x[i].f;
+			if (b->pos != NULL) {
+				b->pos[o] = b->ppos[t][i];
+			}
+		}
+	}
+	free(c.tbl);
+
+	if (b->flags & QGIDX_F_PACKED) {
+		b->pack[p] = mkpack(b->ent[p], b->nent[p],
+				    b->post, b->npack + p, NULL, b->flags);
+		if (UNLIKELY(b->pack[p] == NULL)) {
+			return -1;
+		}
+	}
+	return 0;
+
+nope:
+	free(c.tbl);
+	return -1;
+}
+
+static void*
+distribute(void *clo)
+{
+	struct bld_s *b = clo;
+	unsigned int p;
+
+	while ((p = __atomic_fetch_add(&b->next, 1U, __ATOMIC_RELAXED)) <
+	       NPART) {
+		if (UNLIKELY(distpart(b, p) < 0)) {
+			b->rc = -1;
+		}
+	}
+	return NULL;
+}
+
+static void
+run(void*(*fn)(void*), void *clo, size_t cloz, unsigned int nthr)
+{
+/* run FN on NTHR threads, the T-th thread gets CLO + T * CLOZ */
+	pthread_t thr[nthr];
+	int rc[nthr];
+
+	for (unsigned int t = 0U; t < nthr; t++) {
+		void *c = (char*)clo + t * cloz;
+
+		if ((rc[t] = pthread_create(thr + t, NULL, fn, c))) {
+			/* do it ourselves then */
+			fn(c);
+		}
+	}
+	for (unsigned int t = 0U; t < nthr; t++) {
+		if (!rc[t]) {
+			pthread_join(thr[t], NULL);
+		}
+	}
+	return;
+}
+
+static factor_t*
+mkpost_par(struct qgdir_s **ent, size_t *nent, size_t *npost,
+	   uint32_t **pack, size_t *npack, uint8_t **pos,
+	   unsigned int flags, unsigned int nthr)
+{
+	struct bld_s b = {
+		.flags = flags,
+		.nthr = nthr,
+	};
+	struct wrk_s w[nthr];
+	factor_t frng[nthr + 1U];
+	struct pair_s *pairs[nthr];
+	uint8_t *ppos[nthr];
+	size_t bkt[nthr][NPART + 1U];
+	size_t n = 0U, m = 0U;
+
+	/* split the pool into byte ranges of whole factors */
+	frng[0U] = 1U;
+	for (unsigned int t = 1U; t < nthr; t++) {
+		const size_t o = npool / nthr * t;
+		factor_t lo = frng[t - 1U], hi = ipool + 1U;
+
+		/* find first factor that ends past O */
+		while (lo < hi) {
+			factor_t mid = lo + (hi - lo) / 2U;
+
+			if (poff[mid] <= o) {
+				lo = mid + 1U;
+			} else {
+				hi = mid;
+			}
+		}
+		frng[t] = lo;
+	}
+	frng[nthr] = ipool + 1U;
+	memset(pairs, 0, sizeof(pairs));
+	memset(ppos, 0, sizeof(ppos));
+	b.frng = frng;
+	b.pairs = pairs;
+	b.ppos = flags & QGIDX_F_POS ? ppos : NULL;
+	b.bkt = bkt;
+
+	for (unsigned int t = 0U; t < nthr; t++) {
+		w[t] = (struct wrk_s){&b, t};
+	}
+	run(extract, w, sizeof(*w), nthr);
+	if (UNLIKELY(b.rc < 0)) {
+		goto out;
+	}
+
+	/* partition offsets */
+	for (unsigned int p = 0U; p < NPART; p++) {
+		b.base[p] = n;
+		for (unsigned int t = 0U; t < nthr; t++) {
+			n += bkt[t][p + 1U] - bkt[t][p];
+		}
+	}
+	b.base[NPART] = n;
+	if (UNLIKELY((b.post = arena_grow(&apost, (n ?: 1U) *
+					  sizeof(*b.post))) == NULL)) {
+		goto out;
+	} else if (b.ppos != NULL &&
+		   UNLIKELY((b.pos = arena_grow(&apos, n ?: 1U)) == NULL)) {
+		goto nope;
+	}
+	/* distribution threads share B and pick partitions themselves */
+	run(distribute, &b, 0U, nthr);
+	if (UNLIKELY(b.rc < 0)) {
+		goto nope;
+	}
+
+	/* glue partitions together */
+	for (unsigned int p = 0U; p < NPART; p++) {
+		m += b.nent[p];
+	}
+	if (UNLIKELY((*ent = diralloc(m)) == NULL)) {
+		goto nope;
+	}
+	m = 0U;
+	for (unsigned int p = 0U; p < NPART; p++) {
+		memcpy(*ent + m, b.ent[p], b.nent[p] * sizeof(**ent));
+		m += b.nent[p];
+	}
+	*nent = m;
+	if (flags & QGIDX_F_PACKED) {
+		m = 0U;
+		for (unsigned int p = 0U; p < NPART; p++) {
+			m += b.npack[p];
+		}
+		if (UNLIKELY((*pack = arena_grow(&apack, (m ?: 1U) *
+						 sizeof(**pack))) == NULL)) {
+			free(*ent);
+			goto nope;
+		}
+		m = 0U;
+		for (unsigned int p = 0U, e = 0U; p < NPART; p++) {
+			memcpy(*pack + m, b.pack[p],
+			       b.npack[p] * sizeof(**pack));
+			for (size_t i = 0U; i < b.nent[p]; i++) {
+				(*ent)[e++].off += m;
+			}
+			m += b.npack[p];
+		}
+		*npack = m;
+	}
+	*npost = n;
+	*pos = b.pos;
+	b.pos = NULL;
+out:
+	for (unsigned int t = 0U; t < nthr; t++) {
+		free(pairs[t]);
+		free(ppos[t]);
+	}
+	for (unsigned int p = 0U; p < NPART; p++) {
+		free(b.ent[p]);
+		free(b.pack[p]);
+	}
+	return b.post;
+
+nope:
+	arena_fini(&apost);
+	arena_fini(&apos);
+	b.post = NULL;
+	b.pos = NULL;
+	goto out;
+}
+
+static int
+cmp_df(const void *x, const void *y)
+{
+/* descending number of postings, then ascending key */
+	const struct qgdir_s *a = x, *b = y;
+
+	if (a->n != b->n) {
+		return (a->n < b->n) - (a->n > b->n);
+	}
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+static struct qgdir_s*
+mkqgdir(const struct qgdir_s *ent, size_t nent, size_t *ndir,
+	uint32_t **slots, size_t *nslot)
+{
+/* number the NENT entries ENT by descending number of postings, gram 0
+ * being empty, and put their ids into a hash table of at most 50% load,
+ * frequent grams thus share a few cache lines at the start of the
+ * result and slots are just 4 bytes */
+	struct qgdir_s *dir;
+	uint32_t *tbl;
+	size_t z = 16U;
+
+	if (UNLIKELY(nent >= UINT32_MAX)) {
+		errno = 0, error("\
+Error: too many distinct qgrams");
+		return NULL;
+	}
+	while (z < 2U * nent) {
+		z *= 2U;
+	}
+	if (UNLIKELY((dir = diralloc(nent + 1U)) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((tbl = calloc(z, sizeof(*tbl))) == NULL)) {
+		free(dir);
+		return NULL;
+	}
+	memset(dir, 0, sizeof(*dir));
+	memcpy(dir + 1U, ent, nent * sizeof(*ent));
+	qsort(dir + 1U, nent, sizeof(*dir), cmp_df);
+	for (uint32_t g = 1U; g <= nent; g++) {
+		size_t i = qghash(dir[g].key) & (z - 1U);
+
+		for (; tbl[i]; i = (i + 1U) & (z - 1U));
+		tbl[i] = g;
+	}
+	*ndir = nent + 1U;
+	*slots = tbl;
+	*nslot = z;
+	return dir;
+}
+
+
+static qgidx_t
+mkres(struct _qgidx_s *res, unsigned int flags,
+      struct qgdir_s *dir, size_t ndir, uint32_t *slots, size_t nslot,
+      factor_t *post, size_t npost, uint32_t *pack, size_t npack,
+      uint8_t *pos)
+{
+/* hand DIR, SLOTS, POST, PACK, POS and the pool over to RES */
+	if (!ndups) {
+		/* all multiplicities are 1 */
+		arena_fini(&afmul);
+		fmul = NULL;
+	}
+	free(dups);
+	dups = NULL;
+	zdups = ndups = 0U;
+	res->public = (struct qgidx_s){
+		.flags = flags,
+		.q = qlen,
+		.nfactor = ipool,
+		.pool = pool,
+		.npool = npool,
+		.poff = pef,
+		.fmul = fmul,
+		.dir = dir,
+		.ndir = ndir,
+		.slot = slots,
+		.nslot = nslot,
+		.post = post,
+		.npost = npost,
+		.pack = pack,
+		.npack = npack,
+		.pos = pos,
+		.ford = ford,
+		.lbnd = lbnd,
+		.nlbnd = nlbnd,
+	};
+	if (flags & QGIDX_F_FRONT) {
+		/* see front() */
+		res->public.fpool = (const unsigned char*)pool;
+		res->public.nfpool = npool;
+		res->public.fblk = poff;
+		res->public.pool = NULL;
+		res->public.npool = 0U;
+	}
+	res->mpool = mpool;
+	res->apool = apool, res->apoff = apoff, res->afmul = afmul;
+	res->apost = apost, res->apack = apack, res->apos = apos;
+	/* the pool is owned by RES now */
+	pool = NULL, poff = NULL, fmul = NULL;
+	pef = (struct qgef_s){0U};
+	ford = NULL, lbnd = NULL, nlbnd = 0U;
+	apool = apoff = afmul = (struct arena_s){NULL};
+	apost = apack = apos = (struct arena_s){NULL};
+	npool = 0U;
+	ipool = 0U;
+	mpool = 0;
+	return &res->public;
+}
+
+static qgidx_t
+mkidx(const struct qgidx_opt_s *opt)
+{
+	struct _qgidx_s *res;
+	struct qgdir_s *ent = NULL, *dir;
+	factor_t *post;
+	uint32_t *pack = NULL;
+	uint8_t *pos = NULL;
+	size_t nent = 0U;
+	size_t ndir;
+	uint32_t *slots = NULL;
+	size_t nslot;
+	size_t npost = 0U;
+	size_t npack = 0U;
+	/* roaring containers are a way of packing */
+	unsigned int flags = opt->flags & QGIDX_F_ROAR
+		? opt->flags | QGIDX_F_PACKED : opt->flags;
+	unsigned int nthr = opt->nthreads;
+
+	if (UNLIKELY((flags & (QGIDX_F_BYLEN | QGIDX_F_CLUSTER)) &&
+		     reorder(flags) < 0)) {
+		return NULL;
+	} else if (UNLIKELY(growpoff((size_t)ipool + 1U) < 0)) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	}
+	if (nthr > ipool) {
+		/* at least one factor per thread */
+		nthr = ipool;
+	}
+	if (nthr > 1U) {
+		post = mkpost_par(&ent, &nent, &npost,
+				  &pack, &npack, &pos, flags, nthr);
+	} else if ((post = mkpost(&ent, &nent, &npost, 1U,
+				  flags & QGIDX_F_POS ? &pos : NULL,
+				  &apost, &apos)) != NULL &&
+		   (flags & QGIDX_F_PACKED)) {
+		if (UNLIKELY((pack = mkpack(ent, nent, post, &npack,
+					    &apack, flags)) == NULL)) {
+			free(ent);
+			arena_fini(&apost);
+			post = NULL;
+		}
+	}
+	if (UNLIKELY(post == NULL)) {
+		free(res);
+		return NULL;
+	} else if (pack != NULL) {
+		arena_fini(&apost);
+		post = NULL;
+	}
+	dir = mkqgdir(ent, nent, &ndir, &slots, &nslot);
+	free(ent);
+	if (UNLIKELY(dir == NULL) ||
+	    UNLIKELY((flags & QGIDX_F_FRONT ? front() : efpoff()) < 0)) {
+		free(dir);
+		free(slots);
+		arena_fini(&apost);
+		arena_fini(&apack);
+		arena_fini(&apos);
+		free(res);
+		return NULL;
+	}
+	return mkres(res, flags, dir, ndir, slots, nslot,
+		     post, npost, pack, npack, pos);
+}
+
+static int
+slurp(FILE *fp)
+{
+/* intern all lines of FP */
+	char *line = NULL;
+	size_t llen = 0U;
+	ssize_t nrd;
+	int rc = 0;
+
+	while ((nrd = getline(&line, &llen, fp)) > 0) {
+		nrd -= line[nrd - 1U] == '\n';
+		line[nrd] = '\0';
+
+		if (UNLIKELY((size_t)nrd < qlen)) {
+			continue;
+		}
+
+		/* intern, qgrams are built by mkidx() */
+		if (UNLIKELY((rc = intern(line, nrd)) < 0)) {
+			break;
+		}
+	}
+	free(line);
+	return rc;
+}
+
+qgidx_t
+qgidx_build(FILE *fp, const struct qgidx_opt_s *opt)
+{
+	int rc;
+
+	if (UNLIKELY((opt->flags & QGIDX_F_POS) &&
+		     (opt->flags & (QGIDX_F_PACKED | QGIDX_F_ROAR)))) {
+		errno = 0, error("\
+Error: positional postings cannot be packed");
+		return NULL;
+	} else if (UNLIKELY(setq(opt->q ?: 5U, opt->flags) < 0)) {
+		return NULL;
+	} else if ((rc = mappool(fileno(fp))) == 0) {
+		/* no need to copy anything */
+		return mkidx(opt);
+	} else if (rc == -1 && LIKELY(slurp(fp) == 0)) {
+		return mkidx(opt);
+	}
+	/* out of memory */
+	if (mpool) {
+		munmap(pool, npool);
+	}
+	arena_fini(&apool);
+	arena_fini(&apoff);
+	arena_fini(&afmul);
+	free(dups);
+	pool = NULL, poff = NULL, fmul = NULL, dups = NULL;
+	npool = zdups = ndups = 0U;
+	ipool = 0U;
+	mpool = 0;
+	return NULL;
+}
+
+
+/* appending
+ * The pool of the old index is copied and its factors are remembered
+ * so that new lines can be checked for duplicates.  Only the new lines
+ * are turned into qgrams, their postings are appended to the old lists
+ * which works because new factor ids are greater than all old ones. */
+static int
+seed(qgidx_t old)
+{
+/* make the factors of OLD the current pool */
+	const size_t n = old->nfactor;
+
+	if (UNLIKELY((pool = arena_grow(&apool, old->npool + 1U)) == NULL ||
+		     growpoff(n + 1U) < 0)) {
+		return -1;
+	}
+	if (old->flags & QGIDX_F_FRONT) {
+		/* decode, building needs the plain pool */
+		npool = 0U;
+		poff[0U] = 0U;
+		for (factor_t f = 1U; f <= n; f++) {
+			size_t z;
+			const char *s = qgidx_factor(old, f, &z);
+
+			pool = arena_grow(&apool, npool + z + 1U);
+			if (UNLIKELY(pool == NULL)) {
+				return -1;
+			}
+			memcpy(pool + npool, s, z);
+			npool += z;
+			pool[npool++] = '\n';
+			poff[f] = npool;
+		}
+	} else {
+		memcpy(pool, old->pool, old->npool * sizeof(*pool));
+		for (size_t i = 0U; i <= n; i++) {
+			poff[i] = qgef_get(&old->poff, i);
+		}
+		npool = old->npool;
+	}
+	if (npool && pool[npool - 1U] != '\n') {
+		/* terminate the last factor */
+		pool[npool++] = '\n';
+		poff[n] = npool;
+	}
+	if (old->fmul != NULL) {
+		memcpy(fmul, old->fmul, n * sizeof(*fmul));
+		/* keep the multiplicities even if there are no new dups */
+		ndups = 1U;
+	} else {
+		for (size_t i = 0U; i < n; i++) {
+			fmul[i] = 1U;
+		}
+	}
+	for (ipool = 0U; ipool < n;) {
+		size_t z;
+		const char *s = factor(++ipool, &z);
+
+		remember(ipool, strhash(s, z));
+	}
+	return 0;
+}
+
+static int
+merge(qgidx_t old, struct qgdir_s *restrict ent, size_t *nent,
+      const struct qgdir_s *nu, size_t nnu,
+      const factor_t *post, const uint8_t *pos,
+      factor_t **rpost, uint32_t **rpack, size_t *npack, uint8_t **rpos)
+{
+/* merge the lists of OLD with the NNU new lists NU (sorted by key)
+ * whose postings are in POST, write the merged directory to ENT and
+ * the merged postings to *RPOST in APOST, or *RPACK in APACK if OLD
+ * is packed, and positions from POS to *RPOS in APOS if OLD has
+ * positions */
+	const int packed = old->pack != NULL;
+	const int roar = !!(old->flags & QGIDX_F_ROAR);
+	struct qgdir_s *o;
+	size_t no = 0U, n = 0U, m = 0U;
+	factor_t *res = NULL, *tmp = NULL;
+	uint8_t *rp = NULL;
+	uint32_t *pk = NULL;
+	size_t zres = 0U, ztmp = 0U;
+	int rc = -1;
+
+	if (UNLIKELY((o = diralloc(old->ndir)) == NULL)) {
+		return -1;
+	}
+	/* gram 0 is empty */
+	for (size_t i = 1U; i < old->ndir; i++) {
+		o[no++] = old->dir[i];
+	}
+	qsort(o, no, sizeof(*o), cmp_key);
+
+	if (!packed) {
+		for (size_t j = 0U; j < nnu; j++) {
+			zres += nu[j].n;
+		}
+		zres += old->npost;
+		res = arena_grow(&apost, (zres ?: 1U) * sizeof(*res));
+		if (UNLIKELY(res == NULL)) {
+			goto out;
+		} else if (old->pos != NULL &&
+			   UNLIKELY((rp = arena_grow(&apos, zres ?: 1U)) ==
+				    NULL)) {
+			goto out;
+		}
+	}
+	for (size_t i = 0U, j = 0U; i < no || j < nnu; n++) {
+		const struct qgdir_s x = i < no &&
+			(j >= nnu || o[i].key <= nu[j].key)
+			? o[i++] : (struct qgdir_s){.key = nu[j].key};
+		const struct qgdir_s y = j < nnu && nu[j].key == x.key
+			? nu[j++] : (struct qgdir_s){.key = x.key};
+
+		ent[n] = (struct qgdir_s){x.key, x.n + y.n, m};
+		if (!packed) {
+			memcpy(res + m, old->post + x.off, x.n * sizeof(*res));
+			memcpy(res + m + x.n, post + y.off, y.n * sizeof(*res));
+			if (rp != NULL) {
+				memcpy(rp + m, old->pos + x.off, x.n);
+				memcpy(rp + m + x.n, pos + y.off, y.n);
+			}
+			m += x.n + y.n;
+			continue;
+		}
+		/* packed lists without new postings are copied verbatim */
+		const size_t z = !y.n && roar ? rolen(old->pack + x.off)
+			: !y.n ? pklen(old->pack + x.off, x.n)
+			: roar ? romax(x.n + y.n) : pkmax(x.n + y.n);
+		size_t nx = x.n;
+
+		if (UNLIKELY((pk = arena_grow(&apack, (m + z) *
+					      sizeof(*pk))) == NULL)) {
+			goto out;
+		}
+		if (!y.n) {
+			memcpy(pk + m, old->pack + x.off, z * sizeof(*pk));
+			m += z;
+			continue;
+		} else if (UNLIKELY(x.n + y.n > ztmp)) {
+			factor_t *tp;
+
+			ztmp = x.n + y.n;
+			tp = realloc(tmp, ztmp * sizeof(*tmp));
+			if (UNLIKELY(tp == NULL)) {
+				goto out;
+			}
+			tmp = tp;
+		}
+		if (x.n && roar) {
+			/* containers hold distinct ids only */
+			nx = unroar1(tmp, old->pack + x.off);
+		} else if (x.n) {
+			unpack1(tmp, old->pack + x.off, x.n);
+		}
+		memcpy(tmp + nx, post + y.off, y.n * sizeof(*tmp));
+		m += roar
+			? roar1(pk + m, tmp, nx + y.n)
+			: pack1(pk + m, tmp, nx + y.n);
+	}
+	*nent = n;
+	if (packed) {
+		if (UNLIKELY((pk = arena_grow(&apack, (m ?: 1U) *
+					      sizeof(*pk))) == NULL)) {
+			goto out;
+		}
+		arena_trim(&apack, (m ?: 1U) * sizeof(*pk));
+		*rpack = pk;
+		*npack = m;
+	} else {
+		*rpost = res;
+		*rpos = rp;
+	}
+	rc = 0;
+out:
+	free(o);
+	free(tmp);
+	return rc;
+}
+
+qgidx_t
+qgidx_append(qgidx_t old, FILE *fp)
+{
+	struct _qgidx_s *res;
+	struct qgdir_s *nu = NULL, *ent = NULL, *dir = NULL;
+	uint32_t *slots = NULL;
+	factor_t *upost = NULL, *post = NULL;
+	uint32_t *pack = NULL;
+	uint8_t *upos = NULL, *pos = NULL;
+	size_t nnu = 0U, nent = 0U, nupost = 0U, npack = 0U, ndir, nslot;
+	uint64_t *tomb = NULL;
+	size_t ndead = old->ndead;
+	/* new postings only */
+	struct arena_s tpost = {NULL}, tpos = {NULL};
+	factor_t from;
+
+	if (UNLIKELY(old->flags & QGIDX_F_BYLEN)) {
+		errno = 0, error("\
+Error: cannot append to an index ordered by length");
+		return NULL;
+	} else if (UNLIKELY(old->flags & QGIDX_F_CLUSTER)) {
+		errno = 0, error("\
+Error: cannot append to a clustered index");
+		return NULL;
+	} else if (UNLIKELY(old->nshard)) {
+		errno = 0, error("\
+Error: cannot append to a merged index, append to a shard instead");
+		return NULL;
+	} else if (UNLIKELY(setq(old->q, old->flags) < 0)) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY(seed(old) < 0)) {
+		goto nope;
+	}
+	from = ipool + 1U;
+	if (UNLIKELY(slurp(fp) < 0)) {
+		goto nope;
+	} else if (UNLIKELY((upost = mkpost(&nu, &nnu, &nupost, from,
+					    old->pos ? &upos : NULL,
+					    &tpost, &tpos)) == NULL)) {
+		goto nope;
+	} else if (UNLIKELY((ent = diralloc(old->ndir + nnu)) == NULL)) {
+		goto nope;
+	} else if (UNLIKELY(merge(old, ent, &nent, nu, nnu, upost, upos,
+				  &post, &pack, &npack, &pos) < 0)) {
+		goto nope;
+	} else if (UNLIKELY((dir = mkqgdir(ent, nent, &ndir,
+					   &slots, &nslot)) == NULL)) {
+		goto nope;
+	} else if (UNLIKELY((old->flags & QGIDX_F_FRONT
+			     ? front() : efpoff()) < 0)) {
+		goto nope;
+	} else if (old->tomb != NULL &&
+		   UNLIKELY((tomb = calloc(tombw(ipool),
+					   sizeof(*tomb))) == NULL)) {
+		goto nope;
+	}
+	if (tomb != NULL) {
+		/* deleted factors stay deleted unless added again */
+		memcpy(tomb, old->tomb, tombw(old->nfactor) * sizeof(*tomb));
+		for (factor_t f = 1U; f <= old->nfactor; f++) {
+			const size_t i = f - 1U;
+			const uint32_t was = old->fmul ? old->fmul[i] : 1U;
+
+			if (qgidx_dead(old, f) && fmul[i] > was) {
+				tomb[i / 64U] &= ~(1ULL << i % 64U);
+				fmul[i] -= was;
+				ndead--;
+			}
+		}
+	}
+	free(nu);
+	arena_fini(&tpost);
+	arena_fini(&tpos);
+	free(ent);
+	mkres(res, old->flags, dir, ndir, slots, nslot,
+	      post, old->npost + nupost, pack, npack, pos);
+	res->public.tomb = ndead ? tomb : NULL;
+	res->public.ndead = ndead;
+	if (!ndead) {
+		free(tomb);
+	}
+	return &res->public;
+
+nope:
+	free(nu);
+	arena_fini(&tpost);
+	arena_fini(&tpos);
+	free(ent);
+	free(dir);
+	free(slots);
+	arena_fini(&apost);
+	arena_fini(&apack);
+	arena_fini(&apos);
+	free(res);
+	arena_fini(&apool);
+	arena_fini(&apoff);
+	arena_fini(&afmul);
+	free(dups);
+	pool = NULL, poff = NULL, fmul = NULL, dups = NULL;
+	npool = zdups = ndups = 0U;
+	ipool = 0U;
+	return NULL;
+}
+
+int
+qgidx_volume(qgidx_t idx, unsigned int flags, size_t *nkey, size_t *vol)
+{
+	const qgram_f k = qgidx_kernel(idx->q, flags);
+	struct cnt_s c = {NULL};
+	size_t v = 0U;
+
+	for (factor_t f = 1U; f <= idx->nfactor; f++) {
+		size_t z;
+		const char *s = qgidx_factor(idx, f, &z);
+		qgram_t x[z - idx->q + 1U];
+		const size_t m = k(x, s, z);
+
+		for (size_t i = 0U; i < m; i++) {
+			if (UNLIKELY(cnt_bump(&c, x[i]) < 0)) {
+				free(c.tbl);
+				return -1;
+			}
+		}
+	}
+	for (size_t i = 0U; i < c.ztbl; i++) {
+		v += c.tbl[i].n * c.tbl[i].n;
+	}
+	free(c.tbl);
+	*nkey = c.nkey;
+	*vol = v;
+	return 0;
+}
+
+void
+qgidx_mem(qgidx_t idx, size_t *comm, size_t *used)
+{
+	const struct _qgidx_s *_idx = (const void*)idx;
+	const struct arena_s *a[] = {
+		&_idx->apool, &_idx->apoff, &_idx->afmul,
+		&_idx->apost, &_idx->apack, &_idx->apos,
+	};
+
+	*comm = *used = 0U;
+	for (size_t i = 0U; i < countof(a); i++) {
+		*comm += a[i]->comm;
+		*used += a[i]->used;
+	}
+	return;
+}
+
+static size_t
+snamz(qgidx_t idx)
+{
+/* return the bytes taken by the shard names of IDX */
+	const size_t last = idx->nshard ? idx->snoff[idx->nshard - 1U] : 0U;
+
+	return idx->nshard ? last + strlen(idx->snam + last) + 1U : 0U;
+}
+
+void
+qgidx_bytes(qgidx_t idx, struct qgidx_bytes_s *b)
+{
+	struct qgef_s e;
+
+	*b = (struct qgidx_bytes_s){
+		.pool = idx->npool,
+		.fmul = idx->fmul ? idx->nfactor * sizeof(*idx->fmul) : 0U,
+		.dir = idx->ndir * sizeof(*idx->dir),
+		.slot = idx->nslot * sizeof(*idx->slot),
+		.post = idx->flags & QGIDX_F_PACKED
+		? idx->npack * sizeof(*idx->pack)
+		: idx->npost * sizeof(*idx->post),
+		.pos = idx->pos ? idx->npost * sizeof(*idx->pos) : 0U,
+		.ford = idx->ford ? idx->nfactor * sizeof(*idx->ford) +
+		idx->nlbnd * sizeof(*idx->lbnd) : 0U,
+		.shard = idx->nshard ? (2U * idx->nshard + 1U) *
+		sizeof(*idx->sbnd) + snamz(idx) : 0U,
+		.tomb = tombw(idx->nfactor) * sizeof(*idx->tomb),
+	};
+	if (idx->flags & QGIDX_F_FRONT) {
+		b->pool = idx->nfpool;
+		b->poff = ((idx->nfactor + QGIDX_FRONT_BLK - 1U) /
+			   QGIDX_FRONT_BLK + 1U) * sizeof(*idx->fblk);
+	} else {
+		b->poff = eflayout(&e, idx->nfactor + 1U, idx->npool, NULL) *
+			sizeof(*e.lo);
+	}
+	return;
+}
+
+static size_t
+pad(FILE *fp, size_t o)
+{
+/* pad FP to the next multiple of QGIDX_ALIGN, O is the current offset */
+	static const char zero[QGIDX_ALIGN];
+	const size_t z = -o % QGIDX_ALIGN;
+
+	fwrite(zero, 1, z, fp);
+	return o + z;
+}
+
+static FILE*
+create(const char *fn, char *restrict tmp)
+{
+/* open a temporary file next to FN for writing, its name goes to TMP
+ * which has room for strlen(FN) + 8U bytes, see commit() */
+	const size_t fnz = strlen(fn);
+	mode_t um;
+	FILE *fp;
+	int fd;
+
+	memcpy(tmp, fn, fnz);
+	memcpy(tmp + fnz, ".XXXXXX", 8U);
+	if (UNLIKELY((fd = mkstemp(tmp)) < 0)) {
+		error("\
+Error: cannot open index file `%s' for writing", fn);
+		return NULL;
+	} else if (UNLIKELY((fp = fdopen(fd, "wb")) == NULL)) {
+		error("\
+Error: cannot open index file `%s' for writing", fn);
+		close(fd);
+		unlink(tmp);
+		return NULL;
+	}
+	/* mkstemp() creates files only we can read */
+	um = umask(0);
+	umask(um);
+	fchmod(fd, 0666 & ~um);
+	return fp;
+}
+
+static int
+commit(FILE *fp, const char *fn, const char *tmp)
+{
+/* close FP and rename its file TMP over FN, so whoever has FN mapped
+ * keeps seeing the old index */
+	if (UNLIKELY(ferror(fp) | fclose(fp))) {
+		error("\
+Error: cannot write index file `%s'", fn);
+		unlink(tmp);
+		return -1;
+	} else if (UNLIKELY(rename(tmp, fn) < 0)) {
+		error("\
+Error: cannot replace index file `%s'", fn);
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static size_t
+wrshard(FILE *fp, qgidx_t idx)
+{
+/* write the shard section of IDX, return the number of bytes */
+	size_t o = 0U;
+
+	o += fwrite(idx->sbnd, sizeof(*idx->sbnd), idx->nshard + 1U, fp) *
+		sizeof(*idx->sbnd);
+	o += fwrite(idx->snoff, sizeof(*idx->snoff), idx->nshard, fp) *
+		sizeof(*idx->snoff);
+	o += fwrite(idx->snam, 1, snamz(idx), fp);
+	return o;
+}
+
+static size_t
+wrtomb(FILE *fp, const uint64_t *tomb, size_t n)
+{
+/* write the tombstones TOMB of N factors, or none if NULL, return the
+ * number of bytes */
+	static const uint64_t zero[64U];
+	const size_t nw = tombw(n);
+
+	if (tomb != NULL) {
+		return fwrite(tomb, sizeof(*tomb), nw, fp) * sizeof(*tomb);
+	}
+	for (size_t i = 0U; i < nw; i += countof(zero)) {
+		fwrite(zero, sizeof(*zero),
+		       nw - i < countof(zero) ? nw - i : countof(zero), fp);
+	}
+	return nw * sizeof(*zero);
+}
+
+int
+qgidx_save(qgidx_t idx, const char *fn)
+{
+	struct qgidx_hdr_s hdr = {
+		.magic = QGIDX_MAGIC,
+		.version = QGIDX_VERSION,
+		.wordz = sizeof(size_t),
+		.flags = idx->flags,
+		.q = idx->q,
+		.nfactor = idx->nfactor,
+		.npool = idx->npool,
+		.ndir = idx->ndir,
+		.nslot = idx->nslot,
+		.npost = idx->npost,
+		.npack = idx->npack,
+	};
+	const void *post = idx->post;
+	size_t zpost = idx->npost * sizeof(*idx->post);
+	/* front-coded blocks take the place of the pool */
+	const void *spool = idx->pool;
+	const void *spoff = idx->poff.lo;
+	size_t zpoff;
+	struct qgidx_bytes_s b;
+	/* write to a temporary file first and rename it over FN when
+	 * done, so whoever has FN mapped keeps seeing the old index */
+	char tmp[strlen(fn) + 8U];
+	FILE *fp;
+	size_t o;
+
+	qgidx_bytes(idx, &b);
+	zpoff = b.poff;
+	if (idx->flags & QGIDX_F_FRONT) {
+		spool = idx->fpool;
+		spoff = idx->fblk;
+		hdr.npool = idx->nfpool;
+	}
+
+	/* lay out sections */
+	o = sizeof(hdr);
+	o += -o % QGIDX_ALIGN;
+	hdr.opool = o;
+	o += hdr.npool;
+	o += -o % QGIDX_ALIGN;
+	hdr.opoff = o;
+	o += zpoff;
+	o += -o % QGIDX_ALIGN;
+	hdr.odir = o;
+	o += idx->ndir * sizeof(*idx->dir);
+	o += -o % QGIDX_ALIGN;
+	hdr.oslot = o;
+	o += idx->nslot * sizeof(*idx->slot);
+	o += -o % QGIDX_ALIGN;
+	hdr.opost = o;
+	o += idx->flags & QGIDX_F_PACKED
+		? idx->npack * sizeof(*idx->pack)
+		: idx->npost * sizeof(*idx->post);
+	o += -o % QGIDX_ALIGN;
+	hdr.omul = idx->fmul ? o : 0U;
+	if (idx->fmul) {
+		o += idx->nfactor * sizeof(*idx->fmul);
+		o += -o % QGIDX_ALIGN;
+	}
+	hdr.opos = idx->pos ? o : 0U;
+	if (idx->pos) {
+		o += idx->npost * sizeof(*idx->pos);
+		o += -o % QGIDX_ALIGN;
+	}
+	if (idx->ford) {
+		hdr.oford = o;
+		o += idx->nfactor * sizeof(*idx->ford);
+		o += -o % QGIDX_ALIGN;
+		hdr.olbnd = o;
+		hdr.nlbnd = idx->nlbnd;
+		o += idx->nlbnd * sizeof(*idx->lbnd);
+		o += -o % QGIDX_ALIGN;
+	}
+	if (idx->nshard) {
+		hdr.oshard = o;
+		hdr.nshard = idx->nshard;
+		hdr.nsnam = snamz(idx);
+		o += b.shard;
+		o += -o % QGIDX_ALIGN;
+	}
+	hdr.otomb = o;
+	hdr.ndead = idx->ndead;
+
+	if (idx->flags & QGIDX_F_PACKED) {
+		post = idx->pack;
+		zpost = idx->npack * sizeof(*idx->pack);
+	}
+	if (UNLIKELY((fp = create(fn, tmp)) == NULL)) {
+		return -1;
+	}
+
+	o = fwrite(&hdr, 1, sizeof(hdr), fp);
+	o = pad(fp, o);
+	o += fwrite(spool, 1, hdr.npool, fp);
+	o = pad(fp, o);
+	o += fwrite(spoff, 1, zpoff, fp);
+	o = pad(fp, o);
+	o += fwrite(idx->dir, sizeof(*idx->dir), idx->ndir, fp) *
+		sizeof(*idx->dir);
+	o = pad(fp, o);
+	o += fwrite(idx->slot, sizeof(*idx->slot), idx->nslot, fp) *
+		sizeof(*idx->slot);
+	o = pad(fp, o);
+	o += fwrite(post, 1, zpost, fp);
+	if (idx->fmul) {
+		o = pad(fp, o);
+		o += fwrite(idx->fmul, sizeof(*idx->fmul), idx->nfactor, fp) *
+			sizeof(*idx->fmul);
+	}
+	if (idx->pos) {
+		o = pad(fp, o);
+		o += fwrite(idx->pos, sizeof(*idx->pos), idx->npost, fp);
+	}
+	if (idx->ford) {
+		o = pad(fp, o);
+		o += fwrite(idx->ford, sizeof(*idx->ford), idx->nfactor, fp) *
+			sizeof(*idx->ford);
+		o = pad(fp, o);
+		o += fwrite(idx->lbnd, sizeof(*idx->lbnd), idx->nlbnd, fp) *
+			sizeof(*idx->lbnd);
+	}
+	if (idx->nshard) {
+		o = pad(fp, o);
+		o += wrshard(fp, idx);
+	}
+	o = pad(fp, o);
+	o += wrtomb(fp, idx->tomb, idx->nfactor);
+	return commit(fp, fn, tmp);
+}
+
+
+/* compacting
+ * Deleted factors are dropped from the pool and from the posting lists
+ * of their qgrams, the remaining ones are renumbered in order.  Lists
+ * are decoded and encoded again.  Roaring lists hold distinct ids but
+ * count every occurrence, only for them the deleted factors are split
+ * into qgrams again to take their occurrences off. */
+qgidx_t
+qgidx_compact(qgidx_t idx)
+{
+	const int packed = idx->pack != NULL;
+	const int roar = !!(idx->flags & QGIDX_F_ROAR);
+	const size_t nf = idx->nfactor;
+	struct _qgidx_s *res;
+	struct qgdir_s *ent = NULL, *dir = NULL;
+	uint32_t *slots = NULL;
+	factor_t *cum = NULL, *tmp = NULL, *post = NULL;
+	uint32_t *pack = NULL;
+	uint8_t *tpos = NULL, *pos = NULL;
+	size_t *sbnd = NULL, *gone = NULL;
+	size_t nent = 0U, ndir, nslot, npost = 0U, m = 0U, ztmp = 0U;
+
+	if (UNLIKELY(setq(idx->q, idx->flags) < 0)) {
+		return NULL;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((cum = malloc((nf + 2U) *
+					  sizeof(*cum))) == NULL)) {
+		goto nope;
+	}
+	/* live factor F becomes CUM[F] + 1 */
+	cum[0U] = cum[1U] = 0U;
+	for (factor_t f = 1U; f <= nf; f++) {
+		cum[f + 1U] = cum[f] + !qgidx_dead(idx, f);
+	}
+
+	if (UNLIKELY((pool = arena_grow(&apool, 1U)) == NULL ||
+		     growpoff((size_t)cum[nf + 1U] + 1U) < 0)) {
+		goto nope;
+	}
+	npool = 0U;
+	poff[0U] = 0U;
+	for (factor_t f = 1U; f <= nf; f++) {
+		size_t z;
+		const char *s;
+
+		if (qgidx_dead(idx, f)) {
+			continue;
+		}
+		s = qgidx_factor(idx, f, &z);
+		if (UNLIKELY((pool = arena_grow(
+				      &apool, npool + z + 1U)) == NULL)) {
+			goto nope;
+		}
+		memcpy(pool + npool, s, z);
+		npool += z;
+		pool[npool++] = '\n';
+		fmul[ipool] = idx->fmul != NULL ? idx->fmul[f - 1U] : 1U;
+		poff[++ipool] = npool;
+	}
+	/* keep the multiplicities if there were any */
+	ndups = idx->fmul != NULL;
+
+	if (idx->ford != NULL) {
+		/* input order of the live factors, without the gaps */
+		factor_t *rank = calloc(nf + 1U, sizeof(*rank));
+
+		if (UNLIKELY(rank == NULL)) {
+			goto nope;
+		} else if (UNLIKELY((ford = malloc((ipool ?: 1U) *
+						   sizeof(*ford))) == NULL)) {
+			free(rank);
+			goto nope;
+		}
+		for (factor_t f = 1U; f <= nf; f++) {
+			rank[idx->ford[f - 1U]] = !qgidx_dead(idx, f);
+		}
+		for (size_t v = 1U; v <= nf; v++) {
+			rank[v] += rank[v - 1U];
+		}
+		for (factor_t f = 1U; f <= nf; f++) {
+			if (!qgidx_dead(idx, f)) {
+				ford[cum[f]] = rank[idx->ford[f - 1U]];
+			}
+		}
+		free(rank);
+	}
+	if (idx->lbnd != NULL) {
+		if (UNLIKELY((lbnd = malloc(idx->nlbnd *
+					    sizeof(*lbnd))) == NULL)) {
+			goto nope;
+		}
+		for (size_t c = 0U; c < idx->nlbnd; c++) {
+			lbnd[c] = cum[idx->lbnd[c]] + 1U;
+		}
+		nlbnd = idx->nlbnd;
+	}
+
+	/* occurrences in deleted factors, per qgram */
+	if (roar && UNLIKELY((gone = calloc(idx->ndir,
+					    sizeof(*gone))) == NULL)) {
+		goto nope;
+	}
+	for (factor_t f = 1U; roar && f <= nf; f++) {
+		size_t z;
+		const char *s;
+
+		if (!qgidx_dead(idx, f)) {
+			continue;
+		}
+		s = qgidx_factor(idx, f, &z);
+
+		qgram_t x[z - qlen + 1U];
+		const size_t n = mkqg(x, s, z);
+
+		for (size_t i = 0U; i < n; i++) {
+			gone[qgidx_gram(idx, x[i])]++;
+		}
+	}
+
+	/* posting lists without the deleted factors, gram 0 is empty */
+	if (UNLIKELY((ent = diralloc(idx->ndir)) == NULL)) {
+		goto nope;
+	}
+	memset(ent, 0, idx->ndir * sizeof(*ent));
+	for (size_t g = 1U; g < idx->ndir; g++) {
+		const struct qgdir_s x = idx->dir[g];
+		size_t nx = x.n, k = 0U;
+
+		if (UNLIKELY(x.n > ztmp)) {
+			factor_t *tp;
+			uint8_t *pp;
+
+			ztmp = x.n;
+			if (UNLIKELY((tp = realloc(tmp, ztmp *
+						   sizeof(*tmp))) == NULL)) {
+				goto nope;
+			}
+			tmp = tp;
+			if (idx->pos != NULL &&
+			    UNLIKELY((pp = realloc(tpos, ztmp)) == NULL)) {
+				goto nope;
+			}
+			tpos = idx->pos != NULL ? pp : NULL;
+		}
+		if (!packed) {
+			memcpy(tmp, idx->post + x.off, x.n * sizeof(*tmp));
+		} else if (roar) {
+			nx = unroar1(tmp, idx->pack + x.off);
+		} else {
+			unpack1(tmp, idx->pack + x.off, x.n);
+		}
+		for (size_t j = 0U; j < nx; j++) {
+			if (qgidx_dead(idx, tmp[j])) {
+				continue;
+			} else if (tpos != NULL) {
+				tpos[k] = idx->pos[x.off + j];
+			}
+			tmp[k++] = cum[tmp[j]] + 1U;
+		}
+		if (!k) {
+			/* qgram of deleted factors only */
+			continue;
+		}
+		ent[nent].key = x.key;
+		ent[nent].n = roar ? x.n - gone[g] : k;
+		ent[nent].off = m;
+		npost += ent[nent++].n;
+
+		if (!packed) {
+			if (UNLIKELY((post = arena_grow(&apost, (m + k) *
+							sizeof(*post))) ==
+				     NULL)) {
+				goto nope;
+			}
+			memcpy(post + m, tmp, k * sizeof(*post));
+			if (tpos != NULL) {
+				if (UNLIKELY((pos = arena_grow(
+						      &apos, m + k)) == NULL)) {
+					goto nope;
+				}
+				memcpy(pos + m, tpos, k);
+			}
+			m += k;
+			continue;
+		}
+		const size_t z = roar ? romax(k) : pkmax(k);
+
+		if (UNLIKELY((pack = arena_grow(&apack, (m + z) *
+						sizeof(*pack))) == NULL)) {
+			goto nope;
+		}
+		m += roar ? roar1(pack + m, tmp, k) : pack1(pack + m, tmp, k);
+	}
+	if (packed) {
+		if (UNLIKELY((pack = arena_grow(&apack, (m ?: 1U) *
+						sizeof(*pack))) == NULL)) {
+			goto nope;
+		}
+		arena_trim(&apack, (m ?: 1U) * sizeof(*pack));
+	} else if (UNLIKELY((post = arena_grow(&apost, (m ?: 1U) *
+					       sizeof(*post))) == NULL)) {
+		goto nope;
+	} else if (idx->pos != NULL &&
+		   UNLIKELY((pos = arena_grow(&apos, m ?: 1U)) == NULL)) {
+		goto nope;
+	}
+
+	if (idx->nshard) {
+		/* bounds, name offsets and names in one block */
+		const size_t ns = idx->nshard;
+		const size_t zb = (2U * ns + 1U) * sizeof(*sbnd);
+
+		if (UNLIKELY((sbnd = malloc(zb + snamz(idx))) == NULL)) {
+			goto nope;
+		}
+		for (size_t s = 0U; s <= ns; s++) {
+			sbnd[s] = cum[idx->sbnd[s] + 1U];
+		}
+		memcpy(sbnd + ns + 1U, idx->snoff, ns * sizeof(*sbnd));
+		memcpy((char*)sbnd + zb, idx->snam, snamz(idx));
+	}
+	if (UNLIKELY((dir = mkqgdir(ent, nent, &ndir,
+				    &slots, &nslot)) == NULL)) {
+		goto nope;
+	} else if (UNLIKELY((idx->flags & QGIDX_F_FRONT
+			     ? front() : efpoff()) < 0)) {
+		goto nope;
+	}
+	free(cum);
+	free(gone);
+	free(tmp);
+	free(tpos);
+	free(ent);
+	mkres(res, idx->flags, dir, ndir, slots, nslot,
+	      packed ? NULL : post, npost, pack, packed ? m : 0U, pos);
+	if (sbnd != NULL) {
+		res->public.sbnd = sbnd;
+		res->public.snoff = sbnd + idx->nshard + 1U;
+		res->public.snam = (const char*)(sbnd + 2U * idx->nshard + 1U);
+		res->public.nshard = idx->nshard;
+	}
+	return &res->public;
+
+nope:
+	free(cum);
+	free(gone);
+	free(tmp);
+	free(tpos);
+	free(ent);
+	free(dir);
+	free(slots);
+	free(sbnd);
+	free(ford);
+	free(lbnd);
+	arena_fini(&apost);
+	arena_fini(&apack);
+	arena_fini(&apos);
+	free(res);
+	arena_fini(&apool);
+	arena_fini(&apoff);
+	arena_fini(&afmul);
+	pool = NULL, poff = NULL, fmul = NULL;
+	ford = NULL, lbnd = NULL, nlbnd = 0U;
+	npool = ndups = 0U;
+	ipool = 0U;
+	return NULL;
+}
+
+
+/* merging
+ * The directories of all shards are walked at once in key order, the
+ * merged list of a qgram is the concatenation of its shard lists with
+ * factor ids moved past the factors of earlier shards, and is written
+ * as soon as it is complete.  Packed lists of just one shard keep their
+ * blocks as they only encode differences, roaring containers have to
+ * be rebuilt.  Only the directory and the offsets stay in memory and
+ * the header is written last. */
+struct shard_s {
+	qgidx_t idx;
+	/* factor ids of IDX are moved by this */
+	factor_t base;
+	/* directory of IDX sorted by key and the next entry to merge */
+	struct qgdir_s *o;
+	size_t no;
+	size_t i;
+};
+
+static size_t
+plainz(qgidx_t idx)
+{
+/* return the size of the pool of IDX with all factors terminated */
+	size_t z = 0U;
+
+	if (!(idx->flags & QGIDX_F_FRONT)) {
+		return idx->npool +
+			(idx->npool && idx->pool[idx->npool - 1U] != '\n');
+	}
+	for (factor_t f = 1U; f <= idx->nfactor; f++) {
+		size_t len;
+
+		(void)qgidx_factor(idx, f, &len);
+		z += len + 1U;
+	}
+	return z;
+}
+
+static size_t
+wrpool(FILE *fp, uint64_t *restrict w, const struct qgef_s *e,
+       qgidx_t idx, factor_t base, size_t o)
+{
+/* write the pool of IDX decoded and terminated, its offsets, moved by
+ * O, are values BASE onwards of E laid out at W, return the number of
+ * bytes written */
+	size_t z = 0U;
+
+	if (idx->flags & QGIDX_F_FRONT) {
+		for (factor_t f = 1U; f <= idx->nfactor; f++) {
+			size_t len;
+			const char *s = qgidx_factor(idx, f, &len);
+
+			efset(w, e, base + f - 1U, o + z);
+			fwrite(s, 1, len, fp);
+			fputc('\n', fp);
+			z += len + 1U;
+		}
+		return z;
+	}
+	for (size_t i = 0U; i < idx->nfactor; i++) {
+		efset(w, e, base + i, o + qgef_get(&idx->poff, i));
+	}
+	z = fwrite(idx->pool, 1, idx->npool, fp);
+	if (z && idx->pool[z - 1U] != '\n') {
+		/* terminate the last factor */
+		fputc('\n', fp);
+		z++;
+	}
+	return z;
+}
+
+static int
+wrpost(FILE *fp, FILE *pfp, struct shard_s *sh, size_t nsh,
+       unsigned int flags, struct qgdir_s **rent, size_t *nent, size_t *nw)
+{
+/* merge the posting lists of the NSH shards SH in key order and write
+ * them to FP, positions to PFP if FLAGS has QGIDX_F_POS, store the
+ * merged directory sorted by key in *RENT and the number of words
+ * written in NW */
+	const int packed = !!(flags & QGIDX_F_PACKED);
+	const int roar = !!(flags & QGIDX_F_ROAR);
+	struct qgdir_s *ent = NULL;
+	size_t zent = 0U, n = 0U, m = 0U;
+	factor_t *tmp = NULL;
+	uint32_t *pk = NULL;
+	size_t ztmp = 0U;
+	int rc = -1;
+
+	for (;;) {
+		struct shard_s *one = NULL;
+		qgram_t key = 0U;
+		size_t np = 0U, nt = 0U;
+		size_t nk = 0U;
+
+		/* the smallest key left and its number of postings */
+		for (size_t k = 0U; k < nsh; k++) {
+			if (sh[k].i < sh[k].no &&
+			    (one == NULL || sh[k].o[sh[k].i].key < key)) {
+				one = sh + k;
+				key = sh[k].o[sh[k].i].key;
+			}
+		}
+		if (one == NULL) {
+			break;
+		}
+		for (size_t k = 0U; k < nsh; k++) {
+			if (sh[k].i < sh[k].no && sh[k].o[sh[k].i].key == key) {
+				np += sh[k].o[sh[k].i].n;
+				nk++;
+			}
+		}
+
+		if (UNLIKELY(n >= zent)) {
+			struct qgdir_s *tp;
+
+			zent = (zent * 2U) ?: 1024U;
+			/* realloc() would lose the alignment */
+			if (UNLIKELY((tp = diralloc(zent)) == NULL)) {
+				goto out;
+			}
+			if (n) {
+				memcpy(tp, ent, n * sizeof(*ent));
+			}
+			free(ent);
+			ent = tp;
+			/* padding goes to the file as well */
+			memset(ent + n, 0, (zent - n) * sizeof(*ent));
+		}
+		if (UNLIKELY(np > ztmp)) {
+			factor_t *tp;
+			uint32_t *pp;
+			const size_t zpk = roar ? romax(np) : pkmax(np);
+
+			ztmp = np;
+			if (UNLIKELY((tp = realloc(tmp, ztmp *
+						   sizeof(*tmp))) == NULL)) {
+				goto out;
+			}
+			tmp = tp;
+			if (UNLIKELY((pp = realloc(pk, zpk *
+						   sizeof(*pk))) == NULL)) {
+				goto out;
+			}
+			pk = pp;
+		}
+		ent[n].key = key;
+		ent[n].n = np;
+		ent[n++].off = m;
+
+		if (packed && !roar && nk == 1U) {
+			/* blocks hold differences, just move the first id */
+			const struct qgdir_s x = one->o[one->i++];
+			const size_t z = pklen(one->idx->pack + x.off, x.n);
+
+			memcpy(pk, one->idx->pack + x.off, z * sizeof(*pk));
+			pk[0U] += one->base;
+			m += fwrite(pk, sizeof(*pk), z, fp);
+			continue;
+		}
+		for (size_t k = 0U; k < nsh; k++) {
+			qgidx_t idx = sh[k].idx;
+			struct qgdir_s x;
+			size_t nx = 0U;
+
+			if (sh[k].i >= sh[k].no ||
+			    sh[k].o[sh[k].i].key != key) {
+				continue;
+			}
+			x = sh[k].o[sh[k].i++];
+			if (!packed) {
+				memcpy(tmp + nt, idx->post + x.off,
+				       x.n * sizeof(*tmp));
+				nx = x.n;
+			} else if (roar) {
+				nx = unroar1(tmp + nt, idx->pack + x.off);
+			} else {
+				unpack1(tmp + nt, idx->pack + x.off, x.n);
+				nx = x.n;
+			}
+			for (size_t j = 0U; j < nx; j++) {
+				tmp[nt + j] += sh[k].base;
+			}
+			nt += nx;
+			if (pfp != NULL) {
+				fwrite(idx->pos + x.off, 1, x.n, pfp);
+			}
+		}
+		if (!packed) {
+			m += fwrite(tmp, sizeof(*tmp), nt, fp);
+			continue;
+		}
+		m += fwrite(pk, sizeof(*pk), roar
+			    ? roar1(pk, tmp, nt) : pack1(pk, tmp, nt), fp);
+	}
+	*rent = ent;
+	*nent = n;
+	*nw = m;
+	ent = NULL;
+	rc = 0;
+out:
+	free(ent);
+	free(tmp);
+	free(pk);
+	return rc;
+}
+
+int
+qgidx_merge(const qgidx_t *shard, const char *const *name, size_t nshard,
+	    const char *fn)
+{
+	/* what shards have to agree on */
+	const unsigned int kind = QGIDX_F_EXACT | QGIDX_F_PACKED |
+		QGIDX_F_ROAR | QGIDX_F_POS;
+	const unsigned int flags = nshard ? shard[0U]->flags & kind : 0U;
+	struct qgidx_hdr_s hdr = {
+		.magic = QGIDX_MAGIC,
+		.version = QGIDX_VERSION,
+		.wordz = sizeof(size_t),
+		.flags = flags,
+	};
+	char tmp[strlen(fn) + 8U];
+	struct shard_s *sh = NULL;
+	struct qgdir_s *ent = NULL, *dir = NULL;
+	uint32_t *slots = NULL;
+	size_t nent = 0U, nw = 0U, ndir, nslot;
+	uint64_t *w = NULL;
+	struct qgef_s e;
+	size_t *sbnd = NULL;
+	uint64_t *tomb = NULL;
+	size_t ns = 0U, nnam = 0U;
+	int anymul = 0;
+	FILE *fp, *pfp = NULL;
+	size_t o;
+	int rc = -1;
+
+	if (UNLIKELY(!nshard)) {
+		errno = 0, error("\
+Error: no shards to merge");
+		return -1;
+	}
+	for (size_t k = 0U; k < nshard; k++) {
+		qgidx_t idx = shard[k];
+
+		if (UNLIKELY(idx->flags & (QGIDX_F_BYLEN | QGIDX_F_CLUSTER))) {
+			errno = 0, error("\
+Error: cannot merge `%s', it is ordered by length or clustered",
+					 name[k]);
+			return -1;
+		} else if (UNLIKELY(idx->q != shard[0U]->q ||
+				    (idx->flags ^ flags) & kind)) {
+			errno = 0, error("\
+Error: `%s' and `%s' differ in qgram length, keys or postings",
+					 name[0U], name[k]);
+			return -1;
+		} else if (UNLIKELY(idx->nfactor >
+				    QGIDX_NFACTOR_MAX - hdr.nfactor)) {
+			errno = 0, error("\
+Error: too many lines in shards");
+			return -1;
+		}
+		hdr.nfactor += idx->nfactor;
+		hdr.npool += plainz(idx);
+		hdr.npost += idx->npost;
+		anymul |= idx->fmul != NULL;
+		ns += idx->nshard ?: 1U;
+	}
+	hdr.q = shard[0U]->q;
+	hdr.nshard = ns;
+
+	/* shard bounds and name offsets */
+	if (UNLIKELY((sh = calloc(nshard, sizeof(*sh))) == NULL) ||
+	    UNLIKELY((sbnd = malloc((2U * ns + 1U) *
+				    sizeof(*sbnd))) == NULL)) {
+		goto out;
+	}
+	ns = 0U;
+	for (size_t k = 0U; k < nshard; k++) {
+		qgidx_t idx = shard[k];
+		const factor_t base = k ? sh[k - 1U].base +
+			shard[k - 1U]->nfactor : 0U;
+
+		for (size_t j = 0U; j < idx->nshard; j++, ns++) {
+			sbnd[ns] = base + idx->sbnd[j];
+			sbnd[hdr.nshard + 1U + ns] = nnam + idx->snoff[j];
+		}
+		if (!idx->nshard) {
+			sbnd[ns] = base;
+			sbnd[hdr.nshard + 1U + ns++] = nnam;
+		}
+		nnam += idx->nshard ? snamz(idx) : strlen(name[k]) + 1U;
+
+		/* gram 0 is empty */
+		sh[k] = (struct shard_s){.idx = idx, .base = base};
+		if (UNLIKELY((sh[k].o = diralloc(idx->ndir)) == NULL)) {
+			goto out;
+		}
+		for (size_t i = 1U; i < idx->ndir; i++) {
+			sh[k].o[sh[k].no++] = idx->dir[i];
+		}
+		qsort(sh[k].o, sh[k].no, sizeof(*sh[k].o), cmp_key);
+	}
+	sbnd[ns] = hdr.nfactor;
+	hdr.nsnam = nnam;
+
+	/* deleted factors stay deleted */
+	for (size_t k = 0U; k < nshard; k++) {
+		qgidx_t idx = shard[k];
+
+		if (idx->tomb == NULL) {
+			continue;
+		} else if (tomb == NULL &&
+			   UNLIKELY((tomb = calloc(tombw(hdr.nfactor),
+						   sizeof(*tomb))) == NULL)) {
+			goto out;
+		}
+		for (factor_t f = 1U; f <= idx->nfactor; f++) {
+			const size_t i = sh[k].base + f - 1U;
+
+			tomb[i / 64U] |=
+				(uint64_t)qgidx_dead(idx, f) << i % 64U;
+		}
+		hdr.ndead += idx->ndead;
+	}
+
+	/* offsets are collected while the pool is written */
+	nw = eflayout(&e, hdr.nfactor + 1U, hdr.npool, NULL);
+	if (UNLIKELY((w = calloc(nw, sizeof(*w))) == NULL)) {
+		goto out;
+	}
+	eflayout(&e, hdr.nfactor + 1U, hdr.npool, w);
+
+	if (UNLIKELY((fp = create(fn, tmp)) == NULL)) {
+		goto out;
+	}
+	/* the header is filled in when done */
+	o = fwrite(&hdr, 1, sizeof(hdr), fp);
+	o = pad(fp, o);
+	hdr.opool = o;
+	for (size_t k = 0U; k < nshard; k++) {
+		o += wrpool(fp, w, &e, shard[k], sh[k].base, o - hdr.opool);
+	}
+	efset(w, &e, hdr.nfactor, o - hdr.opool);
+	o = pad(fp, o);
+	hdr.opoff = o;
+	o += fwrite(w, sizeof(*w), nw, fp) * sizeof(*w);
+	o = pad(fp, o);
+	hdr.opost = o;
+	if (flags & QGIDX_F_POS) {
+		/* unpacked, so positions start right after NPOST ids */
+		hdr.opos = hdr.opost + hdr.npost * sizeof(factor_t);
+		hdr.opos += -hdr.opos % QGIDX_ALIGN;
+		if (UNLIKELY((pfp = fopen(tmp, "r+b")) == NULL) ||
+		    UNLIKELY(fseeko(pfp, hdr.opos, SEEK_SET) < 0)) {
+			error("\
+Error: cannot open index file `%s' for writing", fn);
+			goto unl;
+		}
+	}
+	if (UNLIKELY(wrpost(fp, pfp, sh, nshard, flags,
+			    &ent, &nent, &nw) < 0)) {
+		goto unl;
+	}
+	o += nw * sizeof(uint32_t);
+	hdr.npack = flags & QGIDX_F_PACKED ? nw : 0U;
+	if (pfp != NULL) {
+		const int perr = ferror(pfp) | fclose(pfp);
+
+		pfp = NULL;
+		if (UNLIKELY(perr)) {
+			error("\
+Error: cannot write index file `%s'", fn);
+			goto unl;
+		}
+		/* skip the positions */
+		o = hdr.opos + hdr.npost;
+		fseeko(fp, o, SEEK_SET);
+	}
+
+	if (UNLIKELY((dir = mkqgdir(ent, nent, &ndir,
+				    &slots, &nslot)) == NULL)) {
+		goto unl;
+	}
+	hdr.ndir = ndir;
+	hdr.nslot = nslot;
+	o = pad(fp, o);
+	hdr.odir = o;
+	o += fwrite(dir, sizeof(*dir), ndir, fp) * sizeof(*dir);
+	o = pad(fp, o);
+	hdr.oslot = o;
+	o += fwrite(slots, sizeof(*slots), nslot, fp) * sizeof(*slots);
+	if (anymul) {
+		static const uint32_t one = 1U;
+
+		o = pad(fp, o);
+		hdr.omul = o;
+		for (size_t k = 0U; k < nshard; k++) {
+			qgidx_t idx = shard[k];
+
+			if (idx->fmul != NULL) {
+				fwrite(idx->fmul, sizeof(*idx->fmul),
+				       idx->nfactor, fp);
+				continue;
+			}
+			for (size_t i = 0U; i < idx->nfactor; i++) {
+				fwrite(&one, sizeof(one), 1U, fp);
+			}
+		}
+		o += hdr.nfactor * sizeof(one);
+	}
+	o = pad(fp, o);
+	hdr.oshard = o;
+	o += fwrite(sbnd, sizeof(*sbnd), 2U * ns + 1U, fp) * sizeof(*sbnd);
+	for (size_t k = 0U; k < nshard; k++) {
+		if (shard[k]->nshard) {
+			o += fwrite(shard[k]->snam, 1, snamz(shard[k]), fp);
+		} else {
+			o += fwrite(name[k], 1, strlen(name[k]) + 1U, fp);
+		}
+	}
+	o = pad(fp, o);
+	hdr.otomb = o;
+	o += wrtomb(fp, tomb, hdr.nfactor);
+	fseeko(fp, 0, SEEK_SET);
+	fwrite(&hdr, 1, sizeof(hdr), fp);
+	rc = commit(fp, fn, tmp);
+	goto out;
+
+unl:
+	if (pfp != NULL) {
+		fclose(pfp);
+	}
+	fclose(fp);
+	unlink(tmp);
+out:
+	for (size_t k = 0U; sh != NULL && k < nshard; k++) {
+		free(sh[k].o);
+	}
+	free(sh);
+	free(sbnd);
+	free(tomb);
+	free(w);
+	free(ent);
+	free(dir);
+	free(slots);
+	return rc;
+}
+
+qgidx_t
+qgidx_load(const char *fn)
+{
+	const struct qgidx_hdr_s *hdr;
+	struct _qgidx_s *res;
+	struct qgef_s ef;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (UNLIKELY((fd = open(fn, O_RDONLY)) < 0)) {
+		error("\
+Error: cannot open index file `%s'", fn);
+		return NULL;
+	} else if (UNLIKELY(fstat(fd, &st) < 0)) {
+		error("\
+Error: cannot stat index file `%s'", fn);
+		close(fd);
+		return NULL;
+	} else if (UNLIKELY((size_t)st.st_size < sizeof(*hdr))) {
+		errno = 0, error("\
+Error: index file `%s' is truncated", fn);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (UNLIKELY(map == MAP_FAILED)) {
+		error("\
+Error: cannot map index file `%s'", fn);
+		return NULL;
+	}
+
+	hdr = map;
+	if (UNLIKELY(memcmp(hdr->magic, QGIDX_MAGIC, sizeof(hdr->magic)))) {
+		errno = 0, error("\
+Error: `%s' is not an index file", fn);
+		goto unmap;
+	} else if (UNLIKELY(hdr->version != QGIDX_VERSION)) {
+		errno = 0, error("\
+Error: index file `%s' has unsupported version %u",
+				 fn, (unsigned int)hdr->version);
+		goto unmap;
+	} else if (UNLIKELY(hdr->wordz != sizeof(size_t))) {
+		errno = 0, error("\
+Error: index file `%s' was built for a different platform", fn);
+		goto unmap;
+	} else if (UNLIKELY(qgidx_kernel(hdr->q, hdr->flags) == NULL)) {
+		errno = 0, error("\
+Error: index file `%s' uses unsupported qgram length %u",
+				 fn, (unsigned int)hdr->q);
+		goto unmap;
+	} else if (UNLIKELY(!hdr->ndir || hdr->ndir > hdr->nslot ||
+			    hdr->nslot & (hdr->nslot - 1U))) {
+		errno = 0, error("\
+Error: index file `%s' is corrupt", fn);
+		goto unmap;
+	} else if (UNLIKELY(hdr->opool + hdr->npool > (size_t)st.st_size ||
+			    hdr->opoff + (hdr->flags & QGIDX_F_FRONT
+					  ? ((hdr->nfactor + QGIDX_FRONT_BLK -
+					      1U) / QGIDX_FRONT_BLK + 1U) *
+					  sizeof(size_t)
+					  : eflayout(&ef, hdr->nfactor + 1U,
+						     hdr->npool, NULL) *
+					  sizeof(uint64_t)) >
+			    (size_t)st.st_size ||
+			    hdr->odir + hdr->ndir *
+			    sizeof(struct qgdir_s) > (size_t)st.st_size ||
+			    hdr->oslot + hdr->nslot *
+			    sizeof(uint32_t) > (size_t)st.st_size ||
+			    hdr->opost + (hdr->flags & QGIDX_F_PACKED
+					   ? hdr->npack * sizeof(uint32_t)
+					   : hdr->npost * sizeof(factor_t)) >
+			    (size_t)st.st_size ||
+			    hdr->omul + (hdr->omul ? hdr->nfactor : 0U) *
+			    sizeof(uint32_t) > (size_t)st.st_size ||
+			    hdr->opos + (hdr->opos ? hdr->npost : 0U) >
+			    (size_t)st.st_size ||
+			    hdr->oford + (hdr->oford ? hdr->nfactor : 0U) *
+			    sizeof(factor_t) > (size_t)st.st_size ||
+			    hdr->olbnd + hdr->nlbnd *
+			    sizeof(size_t) > (size_t)st.st_size ||
+			    hdr->oshard + (hdr->nshard
+					   ? (2U * hdr->nshard + 1U) *
+					   sizeof(size_t) + hdr->nsnam : 0U) >
+			    (size_t)st.st_size ||
+			    hdr->otomb + tombw(hdr->nfactor) *
+			    sizeof(uint64_t) > (size_t)st.st_size)) {
+		errno = 0, error("\
+Error: index file `%s' is truncated", fn);
+		goto unmap;
+	} else if (UNLIKELY((res = calloc(1, sizeof(*res))) == NULL)) {
+		goto unmap;
+	}
+	res->public = (struct qgidx_s){
+		.flags = hdr->flags,
+		.q = hdr->q,
+		.nfactor = hdr->nfactor,
+		.pool = (const char*)map + hdr->opool,
+		.npool = hdr->npool,
+		.fmul = hdr->omul
+		? (const void*)((const char*)map + hdr->omul) : NULL,
+		.dir = (const void*)((const char*)map + hdr->odir),
+		.pos = hdr->opos
+		? (const void*)((const char*)map + hdr->opos) : NULL,
+		.ford = hdr->oford
+		? (const void*)((const char*)map + hdr->oford) : NULL,
+		.lbnd = hdr->oford && hdr->nlbnd
+		? (const void*)((const char*)map + hdr->olbnd) : NULL,
+		.nlbnd = hdr->oford ? hdr->nlbnd : 0U,
+		.ndir = hdr->ndir,
+		.slot = (const void*)((const char*)map + hdr->oslot),
+		.nslot = hdr->nslot,
+		.npost = hdr->npost,
+		.tomb = hdr->ndead
+		? (const void*)((const char*)map + hdr->otomb) : NULL,
+		.ndead = hdr->ndead,
+	};
+	if (hdr->nshard) {
+		const size_t *sbnd =
+			(const void*)((const char*)map + hdr->oshard);
+
+		res->public.sbnd = sbnd;
+		res->public.snoff = sbnd + hdr->nshard + 1U;
+		res->public.snam = (const char*)(sbnd + 2U * hdr->nshard + 1U);
+		res->public.nshard = hdr->nshard;
+	}
+	if (hdr->flags & QGIDX_F_FRONT) {
+		res->public.fpool = (const void*)res->public.pool;
+		res->public.nfpool = res->public.npool;
+		res->public.fblk = (const void*)((const char*)map + hdr->opoff);
+		res->public.pool = NULL;
+		res->public.npool = 0U;
+	} else {
+		eflayout(&res->public.poff, hdr->nfactor + 1U, hdr->npool,
+			 (const void*)((const char*)map + hdr->opoff));
+	}
+	if (hdr->flags & QGIDX_F_PACKED) {
+		res->public.pack = (const void*)((const char*)map + hdr->opost);
+		res->public.npack = hdr->npack;
+	} else {
+		res->public.post = (const void*)((const char*)map + hdr->opost);
+	}
+	res->map = map;
+	res->mapz = st.st_size;
+	return &res->public;
+
+unmap:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+
+/* deleting
+ * Tombstones are a bitmap of all factors, saved with every index, so
+ * deleting copies the file with that and the count in the header
+ * changed, and renames the copy over the original. */
+int
+qgidx_delete(const char *fn, const factor_t *f, size_t n)
+{
+	const struct _qgidx_s *_idx;
+	const struct qgidx_hdr_s *hdr;
+	struct qgidx_hdr_s nuhdr;
+	qgidx_t idx;
+	uint64_t *tomb = NULL;
+	char tmp[strlen(fn) + 8U];
+	FILE *fp;
+	size_t nw, o;
+	int rc = -1;
+
+	if (UNLIKELY((idx = qgidx_load(fn)) == NULL)) {
+		return -1;
+	}
+	_idx = (const struct _qgidx_s*)idx;
+	hdr = _idx->map;
+	nw = tombw(idx->nfactor);
+	if (UNLIKELY((tomb = malloc(nw * sizeof(*tomb))) == NULL)) {
+		goto out;
+	}
+	memcpy(tomb, (const char*)hdr + hdr->otomb, nw * sizeof(*tomb));
+	nuhdr = *hdr;
+	for (size_t i = 0U; i < n; i++) {
+		const size_t j = f[i] - 1U;
+
+		if (UNLIKELY(!f[i] || f[i] > idx->nfactor)) {
+			errno = 0, error("\
+Error: index file `%s' has no line %zu", fn, (size_t)f[i]);
+			goto out;
+		}
+		nuhdr.ndead += !(tomb[j / 64U] >> j % 64U & 1U);
+		tomb[j / 64U] |= 1ULL << j % 64U;
+	}
+	if (UNLIKELY((fp = create(fn, tmp)) == NULL)) {
+		goto out;
+	}
+	/* all but the header and the tombstones go over verbatim */
+	fwrite(&nuhdr, 1, sizeof(nuhdr), fp);
+	fwrite((const char*)hdr + sizeof(*hdr), 1,
+	       hdr->otomb - sizeof(*hdr), fp);
+	wrtomb(fp, tomb, idx->nfactor);
+	if ((o = hdr->otomb + nw * sizeof(*tomb)) < _idx->mapz) {
+		fwrite((const char*)hdr + o, 1, _idx->mapz - o, fp);
+	}
+	rc = commit(fp, fn, tmp);
+out:
+	free(tomb);
+	qgidx_free(idx);
+	return rc;
+}
+
+
+/* warming up
+ * The mapping is cut into chunks of whole huge pages, one per thread,
+ * and every thread faults its chunk in, by MADV_POPULATE_READ where the
+ * kernel has it or by touching a byte per page otherwise. */
+#define QGIDX_HUGE	(2U * 1024U * 1024U)
+
+struct warm_s {
+	const char *base;
+	size_t z;
+};
+
+static void*
+warm(void *clo)
+{
+	const struct warm_s *w = clo;
+	unsigned char sum = 0U;
+
+#if defined MADV_POPULATE_READ
+	if (madvise(deconst(w->base), w->z, MADV_POPULATE_READ) == 0) {
+		return NULL;
+	}
+#endif	/* MADV_POPULATE_READ */
+	for (size_t o = 0U; o < w->z; o += 4096U) {
+		sum += ((const volatile unsigned char*)w->base)[o];
+	}
+	(void)sum;
+	return NULL;
+}
+
+void
+qgidx_warm(qgidx_t idx, unsigned int nthreads)
+{
+	const struct _qgidx_s *_idx = (const void*)idx;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int nthr = nthreads ?: ncpu > 0 ? (unsigned int)ncpu : 1U;
+	size_t chunk;
+
+	if (_idx->map == NULL) {
+		/* built in memory, nothing to fault in */
+		return;
+	}
+	chunk = (_idx->mapz + nthr - 1U) / nthr;
+	chunk = (chunk + QGIDX_HUGE - 1U) / QGIDX_HUGE * QGIDX_HUGE;
+	nthr = (_idx->mapz + chunk - 1U) / chunk;
+
+	/* just hints, file-backed huge pages need kernel support */
+#if defined MADV_HUGEPAGE
+	(void)madvise(_idx->map, _idx->mapz, MADV_HUGEPAGE);
+#endif	/* MADV_HUGEPAGE */
+	(void)madvise(_idx->map, _idx->mapz, MADV_WILLNEED);
+
+	struct warm_s w[nthr];
+
+	for (unsigned int t = 0U; t < nthr; t++) {
+		const size_t o = t * chunk;
+
+		w[t] = (struct warm_s){
+			(const char*)_idx->map + o,
+			_idx->mapz - o < chunk ? _idx->mapz - o : chunk,
+		};
+	}
+	run(warm, w, sizeof(*w), nthr);
+	return;
+}
+
+void
+qgidx_free(qgidx_t idx)
+{
+	struct _qgidx_s *_idx = deconst(idx);
+
+	if (_idx->map) {
+		munmap(_idx->map, _idx->mapz);
+	} else {
+		if (_idx->mpool) {
+			munmap(deconst(idx->pool), idx->npool);
+		}
+		arena_fini(&_idx->apool);
+		arena_fini(&_idx->apoff);
+		arena_fini(&_idx->afmul);
+		arena_fini(&_idx->apost);
+		arena_fini(&_idx->apack);
+		arena_fini(&_idx->apos);
+		free(deconst(idx->dir));
+		free(deconst(idx->slot));
+		free(deconst(idx->ford));
+		free(deconst(idx->lbnd));
+		free(deconst(idx->tomb));
+		/* names and offsets share the block */
+		free(deconst(idx->sbnd));
+	}
+	free(_idx->fbuf);
+	free(_idx);
+	return;
+}
+
+/* qgidx.c ends here */
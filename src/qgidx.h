@@ -0,0 +1,508 @@
+/*** qgidx.h -- q-gram index
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_qgidx_h_
+#define INCLUDED_qgidx_h_
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint_fast64_t qgram_t;
+typedef uint32_t factor_t;
+typedef uint32_t v4u_t __attribute__((vector_size(16U)));
+
+/* width of legacy and exact keys of qgrams of length Q */
+#define QGRAM_BITS(q)	(4U * (q) + 1U)
+#define QGRAM_XBITS(q)	(5U * (q))
+/* supported qgram lengths */
+#define QGRAM_MIN	3U
+#define QGRAM_MAX	8U
+
+/* qgram kernel, see `mkqgrams()' */
+typedef size_t(*qgram_f)(qgram_t *restrict r, const char *s, size_t z);
+
+/* index flags */
+#define QGIDX_F_PACKED	(1U << 0U)
+/* keys are 5 bits per symbol rather than the legacy 4 bits overlapped */
+#define QGIDX_F_EXACT	(1U << 1U)
+/* postings carry the position of the qgram in the factor */
+#define QGIDX_F_POS	(1U << 2U)
+/* factors are numbered by ascending qgram count */
+#define QGIDX_F_BYLEN	(1U << 3U)
+/* factors are stored front-coded */
+#define QGIDX_F_FRONT	(1U << 4U)
+/* packed postings are roaring containers rather than bit-packed blocks,
+ * always comes with QGIDX_F_PACKED */
+#define QGIDX_F_ROAR	(1U << 5U)
+/* factors are numbered by a minhash signature (within qgram counts) */
+#define QGIDX_F_CLUSTER	(1U << 6U)
+
+/* number of factors per front-coded block */
+#define QGIDX_FRONT_BLK	16U
+
+/* factor ids are 32 bits wide, one past the last id must fit as well */
+#define QGIDX_NFACTOR_MAX	(UINT32_MAX - 1U)
+
+/* positions saturate at this */
+#define QGIDX_POS_MAX	255U
+
+/* aligned so that looking up a qgram touches exactly one cache line */
+struct qgdir_s {
+	qgram_t key;
+	/* number of postings, 0 for empty directory slots */
+	size_t n;
+	/* offset of the first posting */
+	size_t off;
+} __attribute__((aligned(32U)));
+
+/* Elias-Fano coded ascending sequence of N values, see `qgef_get()' */
+struct qgef_s {
+	size_t n;
+	/* number of low bits stored verbatim */
+	unsigned int l;
+	/* the low bits of value I are bits I * L onwards of LO */
+	const uint64_t *lo;
+	/* value V at index I sets bit (V >> L) + I of HI */
+	const uint64_t *hi;
+	/* the bit set by value I * QGEF_SAMPLE */
+	const size_t *sel;
+};
+
+/* one select sample every this many values */
+#define QGEF_SAMPLE	256U
+
+/* bytes taken by the parts of an index, see `qgidx_bytes()' */
+struct qgidx_bytes_s {
+	size_t pool;
+	size_t poff;
+	size_t fmul;
+	size_t dir;
+	size_t slot;
+	/* posting lists, packed or not */
+	size_t post;
+	size_t pos;
+	/* input order and qgram count bands */
+	size_t ford;
+	/* shard bounds and names */
+	size_t shard;
+	size_t tomb;
+};
+
+struct qgidx_opt_s {
+	/* combination of QGIDX_F_* values */
+	unsigned int flags;
+	/* number of threads to build postings with, 0 or 1 is serial */
+	unsigned int nthreads;
+	/* qgram length, 0 for the default of 5 */
+	unsigned int q;
+};
+
+typedef const struct qgidx_s {
+	unsigned int flags;
+	/* qgram length */
+	unsigned int q;
+	/* number of factors, i.e. indexed left lines */
+	size_t nfactor;
+	/* the pool consists of newline-terminated lines, factor F (1-based)
+	 * starts at POOL[POFF(F - 1U)] and ends before POOL[POFF(F)] where
+	 * POFF(I) is `qgef_get(&idx->poff, I)',
+	 * use `qgidx_factor()' to get it */
+	const char *pool;
+	size_t npool;
+	struct qgef_s poff;
+	/* if QGIDX_F_FRONT, POOL and POFF are empty and the factors come
+	 * in front-coded blocks of QGIDX_FRONT_BLK, block B starts at
+	 * FPOOL[FBLK[B]] and the last one ends at FPOOL[NFPOOL] */
+	const unsigned char *fpool;
+	size_t nfpool;
+	const size_t *fblk;
+	/* duplicate lines are interned once, factor F stands for
+	 * FMUL[F - 1U] lines, FMUL is NULL if there are no duplicates */
+	const uint32_t *fmul;
+	/* NDIR - 1 distinct qgrams numbered 1 onwards by descending
+	 * number of postings, DIR[0U] is empty, and an open-addressing
+	 * hash table of NSLOT (a power of 2) slots with their numbers,
+	 * 0 for empty slots, use `qgidx_lookup()' to find the directory
+	 * entry of a qgram */
+	const struct qgdir_s *dir;
+	size_t ndir;
+	const uint32_t *slot;
+	size_t nslot;
+	/* postings of entry D are POST[D.OFF] to POST[D.OFF + D.N] */
+	const factor_t *post;
+	size_t npost;
+	/* if QGIDX_F_PACKED, POST is NULL and the postings of D are
+	 * encoded in PACK[D.OFF] onwards, see `unpack128()', or
+	 * `roarlen()' if QGIDX_F_ROAR */
+	const uint32_t *pack;
+	size_t npack;
+	/* if QGIDX_F_POS, POS[D.OFF + I] is the position of the qgram
+	 * in factor POST[D.OFF + I], counted in qgrams */
+	const uint8_t *pos;
+	/* if QGIDX_F_BYLEN or QGIDX_F_CLUSTER, factor F was number
+	 * FORD[F - 1U] in input order, and if QGIDX_F_BYLEN, factors
+	 * with C qgrams or more start at LBND[C], LBND[NLBND - 1U] is
+	 * NFACTOR + 1 */
+	const factor_t *ford;
+	const size_t *lbnd;
+	size_t nlbnd;
+	/* if merged from shards by `qgidx_merge()', factors SBND[S] + 1
+	 * to SBND[S + 1U] came from shard S whose name is the string at
+	 * SNAM + SNOFF[S], NSHARD is 0 otherwise,
+	 * use `qgidx_shard()' to get the name */
+	const size_t *sbnd;
+	const size_t *snoff;
+	const char *snam;
+	size_t nshard;
+	/* NDEAD factors are deleted, bit (F - 1U) % 64U of TOMB[(F - 1U) /
+	 * 64U] is set if factor F is, TOMB is NULL if none are, their
+	 * postings stay until `qgidx_compact()', use `qgidx_dead()' */
+	const uint64_t *tomb;
+	size_t ndead;
+} *qgidx_t;
+
+
+/**
+ * Return the position of the bit in E->HI that value I sets. */
+static inline size_t
+qgef_sel(const struct qgef_s *e, size_t i)
+{
+	const size_t p = e->sel[i / QGEF_SAMPLE];
+	size_t k = i % QGEF_SAMPLE;
+	size_t w = p / 64U;
+	uint64_t x = e->hi[w] & (~(uint64_t)0U << (p % 64U));
+
+	for (size_t c; k >= (c = __builtin_popcountll(x)); x = e->hi[++w]) {
+		k -= c;
+	}
+	for (; k; k--) {
+		/* drop lowest set bit */
+		x &= x - 1U;
+	}
+	return 64U * w + __builtin_ctzll(x);
+}
+
+/**
+ * Return the position of the first bit set in E->HI after bit P. */
+static inline size_t
+qgef_next(const struct qgef_s *e, size_t p)
+{
+	size_t w = p / 64U;
+	uint64_t x = e->hi[w] & (~(uint64_t)1U << (p % 64U));
+
+	while (!x) {
+		x = e->hi[++w];
+	}
+	return 64U * w + __builtin_ctzll(x);
+}
+
+/**
+ * Return the low bits of value I of E. */
+static inline size_t
+qgef_lo(const struct qgef_s *e, size_t i)
+{
+	const size_t b = i * e->l;
+	const unsigned int sh = b % 64U;
+	uint64_t x;
+
+	if (!e->l) {
+		return 0U;
+	}
+	x = e->lo[b / 64U] >> sh;
+	if (sh + e->l > 64U) {
+		x |= e->lo[b / 64U + 1U] << (64U - sh);
+	}
+	return x & (((uint64_t)1U << e->l) - 1U);
+}
+
+/**
+ * Return value I of E. */
+static inline size_t
+qgef_get(const struct qgef_s *e, size_t i)
+{
+	return (qgef_sel(e, i) - i) << e->l | qgef_lo(e, i);
+}
+
+/**
+ * Decode factor F (1-based) of the front-coded IDX and store its length
+ * in LEN.  The result is valid until the next call. */
+extern const char *qgidx_unfront(qgidx_t idx, factor_t f, size_t *len);
+
+/**
+ * Return factor F (1-based) of the pooled IDX, i.e. one that is not
+ * front-coded, and store its length in LEN. */
+extern const char *qgidx_unpool(qgidx_t idx, factor_t f, size_t *len);
+
+/**
+ * Return factor F (1-based) of IDX and store its length in LEN.
+ * If IDX is front-coded, see `qgidx_unfront()'. */
+static inline const char*
+qgidx_factor(qgidx_t idx, factor_t f, size_t *len)
+{
+	if (idx->flags & QGIDX_F_FRONT) {
+		return qgidx_unfront(idx, f, len);
+	}
+	return qgidx_unpool(idx, f, len);
+}
+
+/**
+ * Return the name of the shard factor F (1-based) of IDX came from,
+ * or NULL if IDX was not merged from shards. */
+static inline const char*
+qgidx_shard(qgidx_t idx, factor_t f)
+{
+	size_t lo = 0U, hi = idx->nshard;
+
+	if (!hi) {
+		return NULL;
+	}
+	/* find the last shard S with SBND[S] < F */
+	while (hi - lo > 1U) {
+		const size_t mid = (lo + hi) / 2U;
+
+		if (idx->sbnd[mid] < f) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return idx->snam + idx->snoff[lo];
+}
+
+/**
+ * Return non-zero if factor F (1-based) of IDX is deleted. */
+static inline int
+qgidx_dead(qgidx_t idx, factor_t f)
+{
+	return idx->tomb != NULL &&
+		idx->tomb[(f - 1U) / 64U] >> (f - 1U) % 64U & 1U;
+}
+
+static inline size_t
+qghash(qgram_t key)
+{
+	uint_fast64_t h = key * 0x9e3779b97f4a7c15ULL;
+	return h ^ h >> 29U;
+}
+
+/**
+ * Return the number of qgram KEY in IDX, or 0 if KEY does not occur.
+ * Frequent qgrams have small numbers and their directory entries stay
+ * in cache. */
+static inline uint32_t
+qgidx_gram(qgidx_t idx, qgram_t key)
+{
+	const size_t m = idx->nslot - 1U;
+	uint32_t g;
+
+	for (size_t i = qghash(key) & m;
+	     (g = idx->slot[i]) && idx->dir[g].key != key; i = (i + 1U) & m);
+	return g;
+}
+
+/**
+ * Return the directory entry of qgram KEY in IDX, its N slot
+ * is 0 if KEY does not occur. */
+static inline struct qgdir_s
+qgidx_lookup(qgidx_t idx, qgram_t key)
+{
+	return idx->dir[qgidx_gram(idx, key)];
+}
+
+/**
+ * Packed posting lists consist of the first factor id followed by
+ * blocks of 128 ids.  Ids are delta-encoded against the id 4 positions
+ * earlier and bit-packed lane-wise into 4 interleaved 32bit streams,
+ * so that 4 ids are decoded at once by plain vector shifts and adds.
+ * Each block starts with its bit width B and has 4 * B words.
+ * The last block is padded by repeating the last id.
+ *
+ * Decode the block at IN into OUT, PREV is the vector of the last 4
+ * decoded ids (or the first id broadcast) and is updated.
+ * Return the number of words consumed. */
+static inline size_t
+unpack128(uint32_t out[static 128U], const uint32_t *in, v4u_t *prev)
+{
+	const unsigned int b = *in++;
+	const uint32_t m = b < 32U ? (1U << b) - 1U : 0xffffffffU;
+	v4u_t p = *prev;
+	v4u_t cur;
+
+	if (!b) {
+		for (size_t v = 0U; v < 32U; v++) {
+			memcpy(out + 4U * v, &p, sizeof(p));
+		}
+		return 1U;
+	}
+	memcpy(&cur, in, sizeof(cur));
+	for (size_t v = 0U, k = 0U, sh = 0U; v < 32U; v++) {
+		v4u_t d = cur >> sh;
+
+		if ((sh += b) >= 32U) {
+			sh -= 32U;
+			if (++k < b) {
+				memcpy(&cur, in + 4U * k, sizeof(cur));
+			}
+			if (sh) {
+				/* straddles words */
+				d |= cur << (b - sh);
+			}
+		}
+		p += d & m;
+		memcpy(out + 4U * v, &p, sizeof(p));
+	}
+	*prev = p;
+	return 1U + 4U * b;
+}
+
+
+/**
+ * Roaring posting lists consist of the number of containers followed
+ * by the containers in ascending order.  A container holds the distinct
+ * ids F with (F - 1) >> 16 == KEY and starts with the words
+ * KEY << 16 | TYPE and N, the payload then is one of
+ * - QGROAR_ARRAY, the N values (F - 1) & 0xffff ascending, 2 per word
+ *   low half first,
+ * - QGROAR_BITMAP, QGROAR_BMW words where bit (F - 1) & 0xffff is set,
+ *   N being the number of bits set,
+ * - QGROAR_RUN, N runs, one per word, as START | (LENGTH - 1) << 16.
+ * Bitmaps thus line up with 64bit words of bits F - 1.
+ *
+ * Return the number of words of the container at C. */
+#define QGROAR_ARRAY	0U
+#define QGROAR_BITMAP	1U
+#define QGROAR_RUN	2U
+#define QGROAR_BMW	2048U
+
+static inline size_t
+roarlen(const uint32_t *c)
+{
+	if ((c[0U] & 0xffffU) == QGROAR_ARRAY) {
+		return 2U + (c[1U] + 1U) / 2U;
+	} else if ((c[0U] & 0xffffU) == QGROAR_BITMAP) {
+		return 2U + QGROAR_BMW;
+	}
+	return 2U + c[1U];
+}
+
+/**
+ * Return the kernel that builds qgrams of length Q with keys as
+ * requested by the QGIDX_F_EXACT bit in FLAGS, or NULL if Q is not
+ * supported.  Kernels build all qgrams from S of length Z and store
+ * them in R, returning the number of qgrams.  If R is NULL they just
+ * count.  Look the kernel up once and keep it. */
+extern qgram_f qgidx_kernel(unsigned int q, unsigned int flags);
+
+/**
+ * Read lines from FP and build a q-gram index over them using OPT.
+ * If FP is a regular file it is mapped rather than copied.
+ * Factor ids are assigned in input order regardless of OPT. */
+extern qgidx_t qgidx_build(FILE *fp, const struct qgidx_opt_s *opt);
+
+/**
+ * Return a new index of the factors of OLD followed by the lines
+ * read from FP.  Factor ids of OLD are kept, lines already in OLD
+ * only bump multiplicities.  OLD is left untouched.  Only the new
+ * lines are split into qgrams, the pool and all posting lists of OLD
+ * are copied though, so this costs time and memory in the size of
+ * the result, not of FP. */
+extern qgidx_t qgidx_append(qgidx_t old, FILE *fp);
+
+/**
+ * Merge the NSHARD indexes SHARD into one and save it to file FN.
+ * The factors of SHARD[I] follow those of SHARD[I - 1U] and keep NAME[I]
+ * as their shard, shards that were merged before keep their own shards.
+ * All shards must agree in qgram length, keys and postings.  Lists are
+ * merged in one pass over the shards in key order and go straight to
+ * FN, so neither the shards nor the result are held in memory. */
+extern int
+qgidx_merge(const qgidx_t *shard, const char *const *name, size_t nshard,
+	    const char *fn);
+
+/**
+ * Mark the N factors F (1-based) of the index saved in file FN as
+ * deleted.  FN is replaced by a copy with the new tombstones, so
+ * processes that have FN mapped see them from their next
+ * `qgidx_load()' on.  Deleted factors keep their postings and still
+ * count towards list lengths until `qgidx_compact()'. */
+extern int qgidx_delete(const char *fn, const factor_t *f, size_t n);
+
+/**
+ * Return a new index of the factors of IDX that are not deleted, with
+ * their postings.  Factors keep their order but are renumbered, lines
+ * need not be turned into qgrams again.  IDX is left untouched. */
+extern qgidx_t qgidx_compact(qgidx_t idx);
+
+/**
+ * Map the index previously saved in file FN. */
+extern qgidx_t qgidx_load(const char *fn);
+
+/**
+ * Count the distinct keys the factors of IDX would have with the
+ * encoding in FLAGS and store them in NKEY, store the sum of the
+ * squared posting list lengths in VOL, which is the number of postings
+ * a probe with the factors themselves would walk. */
+extern int
+qgidx_volume(qgidx_t idx, unsigned int flags, size_t *nkey, size_t *vol);
+
+/**
+ * Store the number of bytes committed for the pool, offsets,
+ * multiplicities and postings of IDX in COMM and those actually in
+ * use in USED.  Both are 0 if IDX is mapped from a file. */
+extern void qgidx_mem(qgidx_t idx, size_t *comm, size_t *used);
+
+/**
+ * Store the number of bytes the parts of IDX take, as saved by
+ * `qgidx_save()' and before alignment, in B. */
+extern void qgidx_bytes(qgidx_t idx, struct qgidx_bytes_s *b);
+
+/**
+ * Fault the file behind IDX in on NTHREADS threads, or one per CPU if
+ * NTHREADS is 0, so that the first queries need not wait for the disk,
+ * and ask for huge pages.  Does nothing if IDX was built rather than
+ * loaded. */
+extern void qgidx_warm(qgidx_t idx, unsigned int nthreads);
+
+/**
+ * Save IDX to file FN so it can be mapped by `qgidx_load()'.
+ * FN is replaced atomically, existing mappings stay valid. */
+extern int qgidx_save(qgidx_t idx, const char *fn);
+
+/**
+ * Free resources associated with IDX. */
+extern void qgidx_free(qgidx_t idx);
+
+#endif	/* INCLUDED_qgidx_h_ */
@@ -0,0 +1,522 @@
+/*** qgindex.c -- inspect and maintain qgjoin indexes
+ *
+ * Copyright (C) 2015-2017 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of qgjoin.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "qgidx.h"
+#include "nifty.h"
+
+
+static void
+__attribute__((format(printf, 1, 2)))
+error(const char *fmt, ...)
+{
+	va_list vap;
+	va_start(vap, fmt);
+	vfprintf(stderr, fmt, vap);
+	va_end(vap);
+	if (errno) {
+		fputc(':', stderr);
+		fputc(' ', stderr);
+		fputs(strerror(errno), stderr);
+	}
+	fputc('\n', stderr);
+	return;
+}
+
+static int
+optu(unsigned int *tgt, const char *arg, unsigned int lo, unsigned int hi)
+{
+/* set TGT to the number spelt by ARG if it is within LO to HI */
+	unsigned long x;
+	char *on;
+
+	errno = 0;
+	x = strtoul(arg, &on, 10);
+	if (UNLIKELY(on == arg || *on || errno || x < lo || x > hi)) {
+		return -1;
+	}
+	*tgt = (unsigned int)x;
+	return 0;
+}
+
+static int
+optf(double *tgt, const char *arg, double lo, double hi)
+{
+/* set TGT to the number spelt by ARG if it is within LO to HI */
+	double x;
+	char *on;
+
+	errno = 0;
+	x = strtod(arg, &on);
+	if (UNLIKELY(on == arg || *on || errno || !(x >= lo && x <= hi))) {
+		return -1;
+	}
+	*tgt = x;
+	return 0;
+}
+
+static const char*
+unkey(char *restrict buf, qgram_t key, unsigned int q, unsigned int flags)
+{
+/* spell exact KEY as its symbols, letters for letters and the digits
+ * that fold into them, 3 for 3, blank for separators and dot for
+ * leading gaps, legacy keys overlap and are printed in hex */
+	if (!(flags & QGIDX_F_EXACT)) {
+		snprintf(buf, 2U * sizeof(key) + 3U, "%#llx",
+			 (unsigned long long)key);
+		return buf;
+	}
+	for (unsigned int i = 0U; i < q; i++) {
+		const unsigned int c = key >> 5U * (q - 1U - i) & 0b11111U;
+
+		buf[i] = (char)(c && c <= 26U ? '@' + c :
+				c == 27U ? '3' : c == 31U ? ' ' : '.');
+	}
+	buf[q] = '\0';
+	return buf;
+}
+
+static size_t
+quantile(qgidx_t idx, double p)
+{
+/* length of posting lists at quantile P, lists are numbered by
+ * descending length */
+	const size_t ngram = idx->ndir - 1U;
+
+	return idx->dir[1U + (size_t)((1. - p) * (double)(ngram - 1U))].n;
+}
+
+
+/* delete */
+struct line_s {
+	const char *s;
+	size_t z;
+};
+
+static int
+cmp_line(const void *x, const void *y)
+{
+	const struct line_s *a = x, *b = y;
+	const int c = memcmp(a->s, b->s, a->z < b->z ? a->z : b->z);
+
+	return c ?: (a->z > b->z) - (a->z < b->z);
+}
+
+static int
+compact1(qgidx_t idx, const char *fn)
+{
+/* save IDX without its deleted factors to FN */
+	qgidx_t res;
+	int rc;
+
+	if (UNLIKELY((res = qgidx_compact(idx)) == NULL)) {
+		errno = 0, error("\
+Error: cannot compact index file `%s'", fn);
+		return -1;
+	}
+	rc = qgidx_save(res, fn);
+	qgidx_free(res);
+	return rc;
+}
+
+
+/* stat */
+static int
+stat1(qgidx_t idx, size_t top)
+{
+/* print the make-up of IDX */
+	static const char *const fnam[] = {
+		"packed", "exact", "positions", "bylength",
+		"front-coded", "roaring", "clustered",
+	};
+	const size_t ngram = idx->ndir - 1U;
+	struct qgidx_bytes_s b;
+	size_t nline = idx->nfactor;
+	size_t comm, used;
+	const char *sep = "";
+
+	if (idx->fmul != NULL) {
+		nline = 0U;
+		for (size_t i = 0U; i < idx->nfactor; i++) {
+			nline += idx->fmul[i];
+		}
+	}
+	fputs("flags\t", stdout);
+	for (size_t i = 0U; i < countof(fnam); i++) {
+		if (idx->flags & 1U << i) {
+			fputs(sep, stdout);
+			fputs(fnam[i], stdout);
+			sep = ",";
+		}
+	}
+	fputc('\n', stdout);
+	fprintf(stdout, "qgram length\t%u\n", idx->q);
+	fprintf(stdout, "lines\t%zu\n", nline);
+	fprintf(stdout, "factors\t%zu\n", idx->nfactor);
+	fprintf(stdout, "deleted\t%zu\n", idx->ndead);
+	fprintf(stdout, "qgrams\t%zu\n", ngram);
+	fprintf(stdout, "postings\t%zu\n", idx->npost);
+
+	if (ngram) {
+		/* the longest 1% of lists and their share of postings */
+		const size_t n1 = (ngram + 99U) / 100U;
+		size_t p1 = 0U;
+
+		for (size_t g = 1U; g <= n1; g++) {
+			p1 += idx->dir[g].n;
+		}
+		fprintf(stdout, "list length max\t%zu\n", idx->dir[1U].n);
+		fprintf(stdout, "list length p99\t%zu\n", quantile(idx, .99));
+		fprintf(stdout, "list length p90\t%zu\n", quantile(idx, .9));
+		fprintf(stdout, "list length median\t%zu\n", quantile(idx, .5));
+		fprintf(stdout, "list length min\t%zu\n", idx->dir[ngram].n);
+		fprintf(stdout, "list length mean\t%g\n",
+			(double)idx->npost / (double)ngram);
+		fprintf(stdout, "postings in longest 1%% of lists\t%g\n",
+			(double)p1 / (double)(idx->npost ?: 1U));
+	}
+	/* lists by length, 1, 2-3, 4-7, ... with their postings */
+	for (size_t lo = 1U, g = ngram; g >= 1U; lo *= 2U) {
+		size_t nl = 0U, np = 0U;
+
+		for (; g >= 1U && idx->dir[g].n < 2U * lo; g--) {
+			nl++;
+			np += idx->dir[g].n;
+		}
+		fprintf(stdout, "lists of length %zu-%zu\t%zu\t%zu\n",
+			lo, 2U * lo - 1U, nl, np);
+	}
+	for (size_t g = 1U; g <= top && g <= ngram; g++) {
+		char buf[2U * sizeof(qgram_t) + 3U + QGRAM_MAX];
+
+		fprintf(stdout, "longest list\t%s\t%zu\n",
+			unkey(buf, idx->dir[g].key, idx->q, idx->flags),
+			idx->dir[g].n);
+	}
+
+	for (size_t s = 0U; s < idx->nshard; s++) {
+		fprintf(stdout, "shard\t%s\t%zu\n",
+			idx->snam + idx->snoff[s],
+			idx->sbnd[s + 1U] - idx->sbnd[s]);
+	}
+
+	qgidx_bytes(idx, &b);
+	fprintf(stdout, "bytes pool\t%zu\n", b.pool);
+	fprintf(stdout, "bytes offsets\t%zu\n", b.poff);
+	fprintf(stdout, "bytes multiplicities\t%zu\n", b.fmul);
+	fprintf(stdout, "bytes directory\t%zu\n", b.dir + b.slot);
+	fprintf(stdout, "bytes postings\t%zu\n", b.post);
+	fprintf(stdout, "bytes positions\t%zu\n", b.pos);
+	fprintf(stdout, "bytes order\t%zu\n", b.ford);
+	fprintf(stdout, "bytes shards\t%zu\n", b.shard);
+	fprintf(stdout, "bytes tombstones\t%zu\n", b.tomb);
+	fprintf(stdout, "bytes total\t%zu\n",
+		b.pool + b.poff + b.fmul + b.dir + b.slot +
+		b.post + b.pos + b.ford + b.shard + b.tomb);
+	qgidx_mem(idx, &comm, &used);
+	if (comm) {
+		/* built in memory */
+		fprintf(stdout, "bytes committed\t%zu\n", comm);
+		fprintf(stdout, "bytes slack\t%zu\n", comm - used);
+	}
+	return 0;
+}
+
+
+#include "qgindex.yucc"
+
+static int
+cmd_stat(const struct yuck_cmd_stat_s argi[static 1U])
+{
+	unsigned int top = 10U;
+	int rc = 0;
+
+	if (argi->top_arg &&
+	    UNLIKELY(optu(&top, argi->top_arg, 0U, UINT_MAX) < 0)) {
+		errno = 0, error("\
+Error: --top must be a number");
+		return 1;
+	} else if (!argi->nargs) {
+		errno = 0, error("\
+Error: no index file given");
+		return 1;
+	}
+	for (size_t i = 0U; i < argi->nargs; i++) {
+		const char *fn = argi->args[i];
+		qgidx_t idx;
+
+		if (argi->build_flag) {
+			struct qgidx_opt_s opt = {
+				.flags = QGIDX_F_EXACT |
+				(argi->pack_flag ? QGIDX_F_PACKED : 0U) |
+				(argi->roaring_flag ? QGIDX_F_ROAR : 0U),
+			};
+			FILE *fp;
+
+			if (argi->threads_arg &&
+			    UNLIKELY(optu(&opt.nthreads, argi->threads_arg,
+					  1U, UINT_MAX) < 0)) {
+				errno = 0, error("\
+Error: --threads must be a positive number");
+				return 1;
+			}
+			if (argi->qgram_arg &&
+			    UNLIKELY(optu(&opt.q, argi->qgram_arg,
+					  QGRAM_MIN, QGRAM_MAX) < 0)) {
+				errno = 0, error("\
+Error: --qgram must be within %u to %u", QGRAM_MIN, QGRAM_MAX);
+				return 1;
+			}
+			if (UNLIKELY((fp = fopen(fn, "r")) == NULL)) {
+				error("\
+Error: cannot open file `%s'", fn);
+				rc = 1;
+				continue;
+			}
+			idx = qgidx_build(fp, &opt);
+			fclose(fp);
+		} else {
+			idx = qgidx_load(fn);
+		}
+		if (UNLIKELY(idx == NULL)) {
+			rc = 1;
+			continue;
+		}
+		if (argi->nargs > 1U) {
+			fprintf(stdout, "file\t%s\n", fn);
+		}
+		rc |= stat1(idx, top);
+		qgidx_free(idx);
+	}
+	return rc;
+}
+static int
+cmd_delete(const struct yuck_cmd_delete_s argi[static 1U])
+{
+/* look the lines up by scanning all factors, that costs a fraction of
+ * building the index and works for any number of lines */
+	const char *fn;
+	struct line_s *l = NULL;
+	size_t nl = 0U, zl = 0U;
+	factor_t *f = NULL;
+	size_t nf = 0U;
+	char *line = NULL;
+	size_t llen = 0U;
+	ssize_t nrd;
+	qgidx_t idx;
+	FILE *fp = stdin;
+	double frac = 0.;
+	int rc = 1;
+
+	if (argi->compact_arg &&
+	    UNLIKELY(optf(&frac, argi->compact_arg, 0., 1.) < 0)) {
+		errno = 0, error("\
+Error: --compact must be within [0, 1]");
+		return 1;
+	} else if (argi->nargs < 1U || argi->nargs > 2U) {
+		errno = 0, error("\
+Error: need an index file and at most one file of lines");
+		return 1;
+	} else if (argi->nargs > 1U &&
+		   UNLIKELY((fp = fopen(argi->args[1U], "r")) == NULL)) {
+		error("\
+Error: cannot open file `%s'", argi->args[1U]);
+		return 1;
+	} else if (UNLIKELY((idx = qgidx_load(fn = argi->args[0U])) == NULL)) {
+		goto clo;
+	}
+
+	while ((nrd = getline(&line, &llen, fp)) > 0) {
+		nrd -= line[nrd - 1U] == '\n';
+
+		if (UNLIKELY(nl >= zl)) {
+			struct line_s *nu;
+
+			zl = (zl * 2U) ?: 1024U;
+			if (UNLIKELY((nu = realloc(l, zl * sizeof(*l))) ==
+				     NULL)) {
+				goto out;
+			}
+			l = nu;
+		}
+		l[nl].s = strndup(line, nrd);
+		l[nl].z = nrd;
+		if (UNLIKELY(l[nl++].s == NULL)) {
+			goto out;
+		}
+	}
+	qsort(l, nl, sizeof(*l), cmp_line);
+	for (factor_t i = 1U; nl && i <= idx->nfactor; i++) {
+		struct line_s k;
+
+		if (qgidx_dead(idx, i)) {
+			continue;
+		}
+		k.s = qgidx_factor(idx, i, &k.z);
+		if (bsearch(&k, l, nl, sizeof(*l), cmp_line) == NULL) {
+			continue;
+		}
+		if (UNLIKELY(!(nf % 1024U))) {
+			factor_t *nu = realloc(f, (nf + 1024U) * sizeof(*f));
+
+			if (UNLIKELY(nu == NULL)) {
+				goto out;
+			}
+			f = nu;
+		}
+		f[nf++] = i;
+	}
+	if (UNLIKELY(qgidx_delete(fn, f, nf) < 0)) {
+		goto out;
+	}
+	rc = 0;
+	if (argi->compact_arg) {
+		qgidx_t now;
+
+		if (UNLIKELY((now = qgidx_load(fn)) == NULL)) {
+			rc = 1;
+		} else if ((double)now->ndead >= frac * (double)now->nfactor) {
+			rc = compact1(now, fn) < 0;
+		}
+		if (now != NULL) {
+			qgidx_free(now);
+		}
+	}
+out:
+	for (size_t i = 0U; i < nl; i++) {
+		free(deconst(l[i].s));
+	}
+	free(l);
+	free(f);
+	free(line);
+	qgidx_free(idx);
+clo:
+	if (fp != stdin) {
+		fclose(fp);
+	}
+	return rc;
+}
+
+static int
+cmd_compact(const struct yuck_cmd_compact_s argi[static 1U])
+{
+	int rc = 0;
+
+	if (!argi->nargs) {
+		errno = 0, error("\
+Error: no index file given");
+		return 1;
+	}
+	for (size_t i = 0U; i < argi->nargs; i++) {
+		const char *fn = argi->args[i];
+		qgidx_t idx;
+
+		if (UNLIKELY((idx = qgidx_load(fn)) == NULL)) {
+			rc = 1;
+			continue;
+		}
+		rc |= compact1(idx, fn) < 0;
+		qgidx_free(idx);
+	}
+	return rc;
+}
+
+static int
+cmd_merge(const struct yuck_cmd_merge_s argi[static 1U])
+{
+	qgidx_t idx[argi->nargs ?: 1U];
+	size_t n = 0U;
+	int rc = 1;
+
+	if (argi->output_arg == NULL) {
+		errno = 0, error("\
+Error: no output file given, see --output");
+		return 1;
+	}
+	for (; n < argi->nargs; n++) {
+		if (UNLIKELY((idx[n] = qgidx_load(argi->args[n])) == NULL)) {
+			goto out;
+		}
+	}
+	rc = qgidx_merge(idx, (const char *const*)argi->args, n,
+			 argi->output_arg) < 0;
+out:
+	while (n) {
+		qgidx_free(idx[--n]);
+	}
+	return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+	yuck_t argi[1U];
+	int rc = 0;
+
+	if (yuck_parse(argi, argc, argv)) {
+		rc = 1;
+		goto out;
+	}
+
+	if (argi->cmd == QGINDEX_CMD_STAT) {
+		rc = cmd_stat(&argi->stat);
+	} else if (argi->cmd == QGINDEX_CMD_MERGE) {
+		rc = cmd_merge(&argi->merge);
+	} else if (argi->cmd == QGINDEX_CMD_DELETE) {
+		rc = cmd_delete(&argi->delete);
+	} else if (argi->cmd == QGINDEX_CMD_COMPACT) {
+		rc = cmd_compact(&argi->compact);
+	} else {
+		errno = 0, error("\
+Error: no command given, see --help");
+		rc = 1;
+	}
+
+out:
+	yuck_free(argi);
+	return rc;
+}
+
+/* qgindex.c ends here */
@@ -44,10 +44,12 @@
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <time.h>
+#include <limits.h>
+#include "qgidx.h"
+#include "prefix.h"
 #include "nifty.h"
 
-typedef uint_fast32_t qgram_t;
-
 
 static void
 __attribute__((format(printf, 1, 2)))
@@ -66,161 +68,35 @@ error(const char *fmt, ...)
 	return;
 }
 
-static size_t
-mkqgrams(qgram_t *restrict r, const char *s, size_t z)
-{
-/* build all qgrams from S of length Z and store in R */
-	static const int_fast8_t tbl[256U] = {
-		[' '] = -1,
-		['-'] = -1,
-		['_'] = -1,
-		['0'] = 'O' - '@',
-		['1'] = 'I' - '@',
-		['2'] = 'Z' - '@',
-		['3'] = 27,
-		['4'] = 'A' - '@',
-		['5'] = 'S' - '@',
-		['6'] = 'G' - '@',
-		['7'] = 'T' - '@',
-		['8'] = 'B' - '@',
-		['9'] = 'Q' - '@',
-		['A'] = 'A' - '@',
-		['B'] = 'B' - '@',
-		['C'] = 'C' - '@',
-		['D'] = 'D' - '@',
-		['E'] = 'E' - '@',
-		['F'] = 'F' - '@',
-		['G'] = 'G' - '@',
-		['H'] = 'H' - '@',
-		['I'] = 'I' - '@',
-		['J'] = 'J' - '@',
-		['K'] = 'K' - '@',
-		['L'] = 'L' - '@',
-		['M'] = 'M' - '@',
-		['N'] = 'N' - '@',
-		['O'] = 'O' - '@',
-		['P'] = 'P' - '@',
-		['Q'] = 'Q' - '@',
-		['R'] = 'R' - '@',
-		['S'] = 'S' - '@',
-		['T'] = 'T' - '@',
-		['U'] = 'U' - '@',
-		['V'] = 'V' - '@',
-		['W'] = 'W' - '@',
-		['X'] = 'X' - '@',
-		['Y'] = 'Y' - '@',
-		['Z'] = 'Z' - '@',
-		['a'] = 'A' - '@',
-		['b'] = 'B' - '@',
-		['c'] = 'C' - '@',
-		['d'] = 'D' - '@',
-		['e'] = 'E' - '@',
-		['f'] = 'F' - '@',
-		['g'] = 'G' - '@',
-		['h'] = 'H' - '@',
-		['i'] = 'I' - '@',
-		['j'] = 'J' - '@',
-		['k'] = 'K' - '@',
-		['l'] = 'L' - '@',
-		['m'] = 'M' - '@',
-		['n'] = 'N' - '@',
-		['o'] = 'O' - '@',
-		['p'] = 'P' - '@',
-		['q'] = 'Q' - '@',
-		['r'] = 'R' - '@',
-		['s'] = 'S' - '@',
-		['t'] = 'T' - '@',
-		['u'] = 'U' - '@',
-		['v'] = 'V' - '@',
-		['w'] = 'W' - '@',
-		['x'] = 'X' - '@',
-		['y'] = 'Y' - '@',
-		['z'] = 'Z' - '@',
-	};
-	qgram_t x = 0U;
-	size_t n = 0U;
-	size_t condens;
-	size_t i, j;
-
-	for (i = 0U, j = 0U, condens = 1U; i < z && j < 5U; i++) {
-		const int_fast8_t h = tbl[(unsigned char)s[i]];
-
-		if (h > 0 || !condens) {
-			x <<= 4U;
-			x ^= h & 0b11111U;
-			j++;
-		}
-		condens = h < 0;
-	}
-	x &= (1U << 21U) - 1U;
-	if (r) {
-		r[n] = x;
-	}
-	n += !!x;
-	/* keep going */
-	for (; i < z; i++) {
-		const int_fast8_t h = tbl[(unsigned char)s[i]];
-
-		x ^= x & 0b111110000000000000000U;
-		if (h > 0 || !condens) {
-			x <<= 4U;
-			x ^= h & 0b11111U;
-			j++;
-		}
-		condens = h < 0;
-		if (r) {
-			r[n] = x;
-		}
-		n += h > 0 || !condens;
-	}
-	return n;
-}
-
-
-typedef size_t factor_t;
-
-static char *pool;
-static size_t npool;
-static size_t zpool;
-static factor_t ipool;
-#define nfactor	ipool
-static size_t *poff;
-static size_t zpoff;
-
-static factor_t *qgrams[1U << 21U];
-static size_t zqgrams[1U << 21U];
-static size_t nqgrams[1U << 21U];
-
-static factor_t
-intern(const char *str, size_t len)
+static int
+optu(unsigned int *tgt, const char *arg, unsigned int lo, unsigned int hi)
 {
-	factor_t r = 0U;
-
-	if (UNLIKELY(npool + len >= zpool)) {
-		zpool = (zpool * 2U) ?: 4096U;
-		pool = realloc(pool, zpool * sizeof(*pool));
+/* set TGT to the number spelt by ARG if it is within LO to HI */
+	unsigned long x;
+	char *on;
+
+	errno = 0;
+	x = strtoul(arg, &on, 10);
+	if (UNLIKELY(on == arg || *on || errno || x < lo || x > hi)) {
+		return -1;
 	}
-	/* copy */
-	memcpy(pool + npool, str, len);
-	npool += len;
-
-	if (UNLIKELY(ipool >= zpoff)) {
-		zpoff = (zpoff * 2U) ?: 512U;
-		poff = realloc(poff, zpoff * sizeof(*poff));
-		poff[0U] = 0U;
-	}
-	poff[r = ++ipool] = npool;
-	return r;
+	*tgt = (unsigned int)x;
+	return 0;
 }
 
 static int
-bang(qgram_t h, factor_t f)
+optf(double *tgt, const char *arg, double lo, double hi)
 {
-	if (UNLIKELY(nqgrams[h] >= zqgrams[h])) {
-		zqgrams[h] = (zqgrams[h] * 2U) ?: 64U;
-		qgrams[h] = realloc(qgrams[h], zqgrams[h] * sizeof(*qgrams[h]));
+/* set TGT to the number spelt by ARG if it is within LO to HI */
+	double x;
+	char *on;
+
+	errno = 0;
+	x = strtod(arg, &on);
+	if (UNLIKELY(on == arg || *on || errno || !(x >= lo && x <= hi))) {
+		return -1;
 	}
-	qgrams[h][nqgrams[h]++] = f;
+	*tgt = x;
 	return 0;
 }
 
@@ -247,6 +123,299 @@ lstrk(uint_fast64_t x)
 	return n;
 }
 
+static uint_fast64_t
+credit(qgidx_t idx, qgram_f mkqgrams,
+       factor_t f, const qgram_t *x, uint_fast64_t stop)
+{
+/* return those bits of STOP whose query qgrams X occur in factor F */
+	size_t z;
+	const char *s = qgidx_factor(idx, f, &z);
+	qgram_t y[z - idx->q + 1U];
+	const size_t m = mkqgrams(y, s, z);
+	uint_fast64_t r = 0U;
+
+	for (uint_fast64_t b = stop; b; b &= b - 1U) {
+		const size_t i = __builtin_ctzll(b);
+
+		for (size_t j = 0U; j < m; j++) {
+			if (y[j] == x[i]) {
+				r |= (uint_fast64_t)(1ULL << i);
+				break;
+			}
+		}
+	}
+	return r;
+}
+
+static uint_fast64_t
+links(qgidx_t idx, qgram_f mkqgrams,
+      factor_t f, const qgram_t *x, size_t n)
+{
+/* return the mask of those of the N query qgrams X that follow their
+ * predecessor in factor F as well */
+	size_t z;
+	const char *s = qgidx_factor(idx, f, &z);
+	qgram_t y[z - idx->q + 1U];
+	const size_t m = mkqgrams(y, s, z);
+	uint_fast64_t r = 0U;
+
+	for (size_t p = 1U; p < m; p++) {
+		for (size_t i = 1U; i < n && i < 64U; i++) {
+			if (y[p] == x[i] && y[p - 1U] == x[i - 1U]) {
+				r |= (uint_fast64_t)(1ULL << i);
+			}
+		}
+	}
+	return r;
+}
+
+static inline size_t
+lwb(const factor_t *p, size_t n, factor_t f)
+{
+/* return the index of the first of the N ascending ids P not below F */
+	size_t lo = 0U, hi = n;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2U;
+
+		if (p[mid] < f) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* for sorting result rows back into input order */
+static const factor_t *ford;
+
+static int
+cmp_ford(const void *x, const void *y)
+{
+	const factor_t a = ford[*(const factor_t*)x];
+	const factor_t b = ford[*(const factor_t*)y];
+	return (a > b) - (a < b);
+}
+
+static inline void
+hit(uint_fast64_t *restrict qc, uint_fast64_t *restrict cc,
+    size_t k, uint_fast64_t w)
+{
+/* record that query qgrams W hit factor K, and make it a candidate */
+	qc[k] |= w;
+	cc[k / 64U] |= (uint_fast64_t)(1ULL << k % 64U);
+	return;
+}
+
+static size_t
+roar(uint_fast64_t *restrict qc, uint_fast64_t *restrict cc,
+     const uint32_t *p, size_t lo, size_t hi, uint_fast64_t w)
+{
+/* record that query qgrams W hit the factors K + 1 with LO <= K < HI
+ * from the roaring containers at P, bitmaps go into CC a word at a time,
+ * return the number of hits */
+	const size_t nc = *p++;
+	size_t r = 0U;
+
+	for (size_t c = 0U; c < nc; c++, p += roarlen(p)) {
+		const size_t base = (size_t)(p[0U] >> 16U) << 16U;
+		const uint32_t *v = p + 2U;
+
+		if (base + 0x10000U <= lo) {
+			continue;
+		} else if (base >= hi) {
+			/* containers are ascending */
+			break;
+		} else if ((p[0U] & 0xffffU) == QGROAR_BITMAP) {
+			const size_t from = lo > base ? (lo - base) / 64U : 0U;
+			const size_t till = hi - base < 0x10000U
+				? (hi - base + 63U) / 64U : QGROAR_BMW / 2U;
+
+			for (size_t i = from; i < till; i++) {
+				const size_t k = base + 64U * i;
+				uint_fast64_t b = (uint_fast64_t)v[2U * i] |
+					(uint_fast64_t)v[2U * i + 1U] << 32U;
+
+				if (k < lo) {
+					b &= ~0ULL << (lo - k);
+				}
+				if (k + 64U > hi) {
+					b &= ~(~0ULL << (hi - k));
+				}
+				cc[k / 64U] |= b;
+				r += __builtin_popcountll(b);
+				for (; b; b &= b - 1U) {
+					qc[k + __builtin_ctzll(b)] |= w;
+				}
+			}
+		} else if ((p[0U] & 0xffffU) == QGROAR_ARRAY) {
+			for (size_t i = 0U; i < p[1U]; i++) {
+				const size_t k = base +
+					(v[i / 2U] >> 16U * (i % 2U) & 0xffffU);
+
+				if (k >= lo && k < hi) {
+					hit(qc, cc, k, w);
+					r++;
+				}
+			}
+		} else {
+			for (size_t i = 0U; i < p[1U]; i++) {
+				const size_t s = base + (v[i] & 0xffffU);
+				const size_t e = s + (v[i] >> 16U) + 1U;
+
+				for (size_t k = s > lo ? s : lo;
+				     k < e && k < hi; k++) {
+					hit(qc, cc, k, w);
+					r++;
+				}
+			}
+		}
+	}
+	return r;
+}
+
+/* diagonal tracking for positional postings */
+struct diag_s {
+	/* positions (mod 64) where the last query qgram to hit this
+	 * factor hit it, and where its predecessor hit */
+	uint_fast64_t cur, prv;
+	/* the last query qgram to hit, plus 1 */
+	size_t last;
+	/* bit I is set if query qgram I continues the diagonal
+	 * of query qgram I - 1 */
+	uint_fast64_t lnk;
+};
+
+static inline void
+diag(struct diag_s *restrict d, size_t i, unsigned int p,
+     uint_fast64_t w, int any)
+{
+/* record that query qgram I (bit W) hits at position P,
+ * if ANY consider it to continue the diagonal regardless */
+	if (d->last != i + 1U) {
+		d->prv = d->last == i ? d->cur : 0U;
+		d->cur = 0U;
+		d->last = i + 1U;
+	}
+	d->cur |= (uint_fast64_t)(1ULL << p % 64U);
+	if (any || p >= QGIDX_POS_MAX ||
+	    d->prv & (uint_fast64_t)(1ULL << (p - 1U) % 64U)) {
+		d->lnk |= w;
+	}
+	return;
+}
+
+static inline size_t
+streak(const uint_fast64_t *qc, const struct diag_s *dg,
+       size_t k, uint_fast64_t more)
+{
+/* longest streak of factor K with query qgrams MORE credited,
+ * along diagonals if DG is given */
+	if (dg == NULL) {
+		return lstrk(qc[k] | more);
+	}
+	/* a run of N links is a diagonal of N + 1 qgrams */
+	return lstrk(dg[k].lnk | more) + 1U;
+}
+
+
+
+/* right input, NARG more files ARG follow the one at FP */
+struct rght_s {
+	FILE *fp;
+	char *const *arg;
+	size_t narg;
+	/* set if one of them could not be opened */
+	int err;
+};
+
+static ssize_t
+rdrght(char **line, size_t *llen, struct rght_s *r)
+{
+/* read the next line of the right input R, moving on to its next file
+ * whenever one is exhausted */
+	ssize_t nrd;
+
+	while ((nrd = getline(line, llen, r->fp)) < 0 && r->narg) {
+		FILE *fp;
+
+		if (UNLIKELY((fp = fopen(*r->arg, "r")) == NULL)) {
+			error("\
+Error: cannot open right input file `%s'", *r->arg);
+			r->narg = 0U;
+			r->err = 1;
+			break;
+		}
+		fclose(r->fp);
+		r->fp = fp;
+		r->arg++;
+		r->narg--;
+	}
+	return nrd;
+}
+
+static int
+pxjoin(qgidx_t idx, struct rght_s *r, double thr, int alldup, int stats)
+{
+/* join the lines of R against IDX with the prefix filter */
+	prefix_t px;
+	char *line = NULL;
+	size_t llen = 0U;
+	ssize_t nrd;
+
+	if (UNLIKELY((px = prefix_build(idx, thr)) == NULL)) {
+		error("\
+Error: cannot build prefix index");
+		return -1;
+	}
+	while ((nrd = rdrght(&line, &llen, r)) > 0) {
+		struct prefix_hit_s *h;
+		size_t nh;
+
+		nrd -= line[nrd - 1U] == '\n';
+		line[nrd] = '\0';
+
+		nh = prefix_probe(px, line, nrd, &h);
+		for (size_t i = 0U; i < nh; i++) {
+			size_t plen;
+			const char *str = qgidx_factor(idx, h[i].f, &plen);
+			const char *shd = qgidx_shard(idx, h[i].f);
+			size_t mul = 1U;
+
+			if (alldup && idx->fmul) {
+				/* one row for every duplicate */
+				mul = idx->fmul[h[i].f - 1U];
+			}
+			do {
+				fwrite(str, 1, plen, stdout);
+				fputc('\t', stdout);
+				fwrite(line, 1, nrd, stdout);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", h[i].o);
+				fputc('\t', stdout);
+				fprintf(stdout, "%g", h[i].sim);
+				if (shd != NULL) {
+					fputc('\t', stdout);
+					fputs(shd, stdout);
+				}
+				fputc('\n', stdout);
+			} while (--mul);
+		}
+	}
+	free(line);
+
+	if (stats) {
+		size_t nscan, ncand;
+
+		prefix_stats(px, &nscan, &ncand);
+		fprintf(stderr, "postings scanned\t%zu\n", nscan);
+		fprintf(stderr, "candidates verified\t%zu\n", ncand);
+	}
+	prefix_free(px);
+	return 0;
+}
+
 
 #include "qgjoin.yucc"
 
@@ -254,125 +423,421 @@ int
 main(int argc, char *argv[])
 {
 	yuck_t argi[1U];
-	FILE *fp1, *fp2;
+	qgidx_t idx;
+	FILE *fp2;
+	size_t nfactor;
+	/* qgram length of the index and its kernel */
+	unsigned int q;
+	qgram_f mkqgrams;
+	size_t maxdf = -1ULL;
+	/* --max-df as given, fractions of the number of factors below 1 */
+	double df = 0.;
+	/* length ratio below which lines cannot qualify */
+	double thr = 0.;
+	/* postings walked and postings skipped because of MAXDF */
+	size_t nscan = 0U, nskip = 0U;
+	/* threads to build or warm up with, 0 for the default */
+	unsigned int nthr = 0U;
+	/* qgram length to build with, 0 for the default */
+	unsigned int qarg = 0U;
+	/* for time to ready */
+	struct timespec t0;
 	int rc = 0;
 
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	if (yuck_parse(argi, argc, argv)) {
 		rc = 1;
 		goto out;
 	}
 
-	if (!argi->nargs) {
+	if (argi->append_arg && !argi->load_index_arg) {
 		errno = 0, error("\
-Error: left input file not given");
+Error: --append needs an index to append to, see --load-index");
 		rc = 1;
 		goto out;
-	} else if (UNLIKELY((fp1 = fopen(argi->args[0U], "r")) == NULL)) {
-		error("\
-Error: cannot open left input file");
+	} else if (argi->append_arg && !argi->save_index_arg) {
+		/* write back to where it came from */
+		argi->save_index_arg = argi->load_index_arg;
+	}
+	if (argi->warm_up_flag && !argi->load_index_arg) {
+		errno = 0, error("\
+Error: --warm-up needs an index to warm up, see --load-index");
 		rc = 1;
 		goto out;
-	} else if (argi->nargs == 1U) {
-		fp2 = stdin;
-	} else if (UNLIKELY((fp2 = fopen(argi->args[1U], "r")) == NULL)) {
-		error("\
+	}
+	if (argi->prefix_flag && !argi->threshold_arg) {
+		errno = 0, error("\
+Error: --prefix needs a similarity threshold, see --threshold");
+		rc = 1;
+		goto out;
+	}
+	if (argi->threads_arg &&
+	    UNLIKELY(optu(&nthr, argi->threads_arg, 1U, UINT_MAX) < 0)) {
+		errno = 0, error("\
+Error: --threads must be a positive number");
+		rc = 1;
+		goto out;
+	} else if (argi->qgram_arg &&
+		   UNLIKELY(optu(&qarg, argi->qgram_arg,
+				 QGRAM_MIN, QGRAM_MAX) < 0)) {
+		errno = 0, error("\
+Error: --qgram must be within %u to %u", QGRAM_MIN, QGRAM_MAX);
+		rc = 1;
+		goto out;
+	} else if (argi->max_df_arg &&
+		   UNLIKELY(optf(&df, argi->max_df_arg, 0., HUGE_VAL) < 0 ||
+			    !(df > 0.))) {
+		errno = 0, error("\
+Error: --max-df must be a positive number");
+		rc = 1;
+		goto out;
+	} else if (argi->threshold_arg &&
+		   UNLIKELY(optf(&thr, argi->threshold_arg, 0., 1.) < 0 ||
+			    !(thr > 0.))) {
+		errno = 0, error("\
+Error: --threshold must be within (0, 1]");
+		rc = 1;
+		goto out;
+	}
+
+	if (argi->load_index_arg) {
+		/* left side comes from a saved index */
+		idx = qgidx_load(argi->load_index_arg);
+		if (UNLIKELY(idx == NULL)) {
+			rc = 1;
+			goto out;
+		} else if (argi->append_arg) {
+			qgidx_t nu;
+			FILE *fp;
+
+			fp = fopen(argi->append_arg, "r");
+			if (UNLIKELY(fp == NULL)) {
+				error("\
+Error: cannot open file to append");
+				rc = 1;
+				goto fre;
+			}
+			nu = qgidx_append(idx, fp);
+			fclose(fp);
+			if (UNLIKELY(nu == NULL)) {
+				error("\
+Error: cannot append to index");
+				rc = 1;
+				goto fre;
+			}
+			qgidx_free(idx);
+			idx = nu;
+		}
+		if (!argi->nargs && argi->append_arg) {
+			/* just append */
+			fp2 = NULL;
+		} else if (!argi->nargs) {
+			fp2 = stdin;
+		} else if (UNLIKELY((fp2 = fopen(argi->args[0U], "r")) ==
+				    NULL)) {
+			error("\
 Error: cannot open right input file");
+			rc = 1;
+			goto fre;
+		}
+	} else if (!argi->nargs) {
+		errno = 0, error("\
+Error: left input file not given");
 		rc = 1;
-		fclose(fp1);
 		goto out;
+	} else {
+		struct qgidx_opt_s opt = {
+			.flags = (argi->pack_flag ? QGIDX_F_PACKED : 0U) |
+			(argi->roaring_flag ? QGIDX_F_ROAR : 0U) |
+			(argi->legacy_keys_flag ? 0U : QGIDX_F_EXACT) |
+			(argi->positions_flag ? QGIDX_F_POS : 0U) |
+			(argi->threshold_arg ? QGIDX_F_BYLEN : 0U) |
+			(argi->cluster_flag ? QGIDX_F_CLUSTER : 0U) |
+			(argi->front_code_flag ? QGIDX_F_FRONT : 0U),
+		};
+		FILE *fp1;
+
+		if (UNLIKELY((fp1 = fopen(argi->args[0U], "r")) == NULL)) {
+			error("\
+Error: cannot open left input file");
+			rc = 1;
+			goto out;
+		}
+		opt.nthreads = nthr;
+		opt.q = qarg;
+		idx = qgidx_build(fp1, &opt);
+		/* proceed with fp2 */
+		fclose(fp1);
+
+		if (UNLIKELY(idx == NULL)) {
+			error("\
+Error: cannot build index from left input file");
+			rc = 1;
+			goto out;
+		} else if (argi->nargs > 1U) {
+			fp2 = fopen(argi->args[1U], "r");
+			if (UNLIKELY(fp2 == NULL)) {
+				error("\
+Error: cannot open right input file");
+				rc = 1;
+				goto fre;
+			}
+		} else if (argi->save_index_arg) {
+			/* just build the index */
+			fp2 = NULL;
+		} else {
+			fp2 = stdin;
+		}
 	}
 
-	char *line = NULL;
-	size_t llen = 0U;
-	ssize_t nrd;
-	while ((nrd = getline(&line, &llen, fp1)) > 0) {
-		nrd -= line[nrd - 1U] == '\n';
-		line[nrd] = '\0';
+	if (argi->warm_up_flag) {
+		struct timespec t1;
 
-		if (UNLIKELY(nrd < 5U)) {
-			continue;
+		qgidx_warm(idx, nthr);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fprintf(stderr, "time to ready\t%.6f\n",
+			(double)(t1.tv_sec - t0.tv_sec) +
+			(double)(t1.tv_nsec - t0.tv_nsec) * 1e-9);
+	}
+
+	if (argi->key_stats_flag) {
+		size_t nk[2U], v[2U];
+
+		if (UNLIKELY(qgidx_volume(idx, 0U, nk + 0U, v + 0U) < 0 ||
+			     qgidx_volume(idx, QGIDX_F_EXACT,
+					  nk + 1U, v + 1U) < 0)) {
+			error("\
+Error: cannot compare qgram keys");
+			rc = 1;
+			if (fp2 != NULL) {
+				fclose(fp2);
+			}
+			goto fre;
 		}
+		fprintf(stderr, "keys legacy\t%zu\n", nk[0U]);
+		fprintf(stderr, "keys exact\t%zu\n", nk[1U]);
+		fprintf(stderr, "volume legacy\t%zu\n", v[0U]);
+		fprintf(stderr, "volume exact\t%zu\n", v[1U]);
+	}
 
-		/* intern */
-		factor_t f = intern(line, nrd);
-		/* build all 5-grams */
-		qgram_t x[nrd - 5U + 1];
-		const size_t n = mkqgrams(x, line, nrd);
+	if (argi->stats_flag) {
+		size_t comm, used;
 
-		for (size_t i = 0U; i < n; i++) {
-			/* store */
-			bang(x[i], f);
+		qgidx_mem(idx, &comm, &used);
+		fprintf(stderr, "bytes committed\t%zu\n", comm);
+		fprintf(stderr, "bytes used\t%zu\n", used);
+	}
+
+	if (argi->save_index_arg &&
+	    UNLIKELY(qgidx_save(idx, argi->save_index_arg) < 0)) {
+		rc = 1;
+		if (fp2 != NULL) {
+			fclose(fp2);
 		}
+		goto fre;
+	} else if (fp2 == NULL) {
+		goto fre;
 	}
-	/* proceed with fp2 */
-	fclose(fp1);
 
+	/* with --load-index all arguments are right input files */
+	struct rght_s rght = {.fp = fp2};
+	char *line = NULL;
+	size_t llen = 0U;
+	ssize_t nrd;
+
+	if (argi->load_index_arg && argi->nargs) {
+		rght.arg = argi->args + 1U;
+		rght.narg = argi->nargs - 1U;
+	}
+	nfactor = idx->nfactor;
+	q = idx->q;
+	mkqgrams = qgidx_kernel(q, idx->flags);
+	if (df >= 1.) {
+		maxdf = df < (double)SIZE_MAX ? (size_t)df : SIZE_MAX;
+	} else if (df > 0.) {
+		/* fractions are relative to the number of factors */
+		maxdf = (size_t)(df * (double)nfactor);
+	}
+	if (argi->prefix_flag) {
+		if (UNLIKELY(pxjoin(idx, &rght, thr,
+				    argi->all_duplicates_flag,
+				    argi->stats_flag) < 0)) {
+			rc = 1;
+		}
+		fclose(rght.fp);
+		rc |= rght.err;
+		goto fre;
+	}
+	if (thr > 0. && idx->lbnd == NULL) {
+		errno = 0, error("\
+Warning: index is not ordered by length, --threshold is ignored");
+		thr = 0.;
+	}
+	ford = idx->ford;
 	/* for streak track-keeping */
-	static size_t *strk;
+	static factor_t *strk;
 	static size_t zstrk;
 
 	uint_fast64_t *qc = malloc(nfactor * sizeof(*qc));
 	uint_fast64_t *cc = malloc(((nfactor / 64U) + 1U) * sizeof(*cc));
+	struct diag_s *dg = NULL;
+
+	if (idx->pos != NULL) {
+		dg = malloc(nfactor * sizeof(*dg));
+	}
 
-	while ((nrd = getline(&line, &llen, fp2)) > 0) {
+	while ((nrd = rdrght(&line, &llen, &rght)) > 0) {
 		uint_fast64_t w;
+		/* query qgrams left out of candidate generation */
+		uint_fast64_t stop;
 		size_t nq;
 		double qq;
 
 		nrd -= line[nrd - 1U] == '\n';
 		line[nrd] = '\0';
 
-		if (UNLIKELY(nrd < 5U)) {
+		if (UNLIKELY((size_t)nrd < q)) {
 			continue;
 		}
 
-		memset(qc, 0, nfactor * sizeof(*qc));
-		memset(cc, 0, ((nfactor / 64U) + 1U) * sizeof(*cc));
+		/* build all qgrams */
+		qgram_t x[nrd - q + 1U];
+		const size_t n = mkqgrams(x, line, nrd);
+
+		/* factors FLO to FHI (exclusive) can qualify by length */
+		factor_t flo = 1U, fhi = nfactor + 1U;
+
+		if (thr > 0.) {
+			const double lo = thr * (double)n - 1e-9;
+			const double hi = (double)n / thr + 1e-9;
+			const size_t top = idx->nlbnd - 1U;
+			size_t l = (size_t)lo + ((double)(size_t)lo < lo);
+
+			flo = idx->lbnd[l < top ? l : top];
+			fhi = idx->lbnd[
+				hi < (double)top ? (size_t)hi + 1U : top];
+		}
+
+		memset(qc + flo - 1U, 0, (fhi - flo) * sizeof(*qc));
+		memset(cc + (flo - 1U) / 64U, 0,
+		       ((fhi - 1U) / 64U - (flo - 1U) / 64U + 1U) *
+		       sizeof(*cc));
+		if (dg != NULL) {
+			memset(dg + flo - 1U, 0, (fhi - flo) * sizeof(*dg));
+		}
 		w = 1U;
+		stop = 0U;
 		nq = 0U;
 		qq = 0.;
 
-		/* build all 5-grams */
-		qgram_t x[nrd - 5U + 1U];
-		const size_t n = mkqgrams(x, line, nrd);
-
 		for (size_t i = 0U; i < n; i++) {
 			/* look up factors in global qgram array */
-			const qgram_t y = x[i];
-			for (size_t j = 0U; j < nqgrams[y]; j++) {
-				qc[qgrams[y][j] - 1U] |= w;
+			const struct qgdir_s y = qgidx_lookup(idx, x[i]);
+
+			if (y.n > maxdf) {
+				/* stop gram, credit it to candidates later */
+				stop |= w;
+				nskip += y.n;
+			} else if ((idx->flags & QGIDX_F_ROAR) && y.n) {
+				nscan += roar(qc, cc, idx->pack + y.off,
+					      flo - 1U, fhi - 1U, w);
+			} else if (idx->pack != NULL && y.n) {
+				const uint32_t *p = idx->pack + y.off;
+				v4u_t prev = {*p, *p, *p, *p};
+
+				p++;
+				for (size_t j = 0U; j < y.n; j += 128U) {
+					uint32_t b[128U];
+					const size_t m = y.n - j < 128U
+						? y.n - j : 128U;
+
+					p += unpack128(b, p, &prev);
+					nscan += m;
+					if (b[m - 1U] < flo) {
+						continue;
+					}
+					for (size_t l = 0U; l < m; l++) {
+						if (b[l] < flo) {
+							continue;
+						} else if (b[l] >= fhi) {
+							/* ascending */
+							break;
+						}
+						hit(qc, cc, b[l] - 1U, w);
+					}
+					if (b[m - 1U] >= fhi) {
+						break;
+					}
+				}
+			} else if (idx->post != NULL) {
+				const factor_t *p = idx->post + y.off;
+				/* only the band FLO to FHI of the list */
+				const size_t lo = lwb(p, y.n, flo);
+				const size_t hi =
+					lo + lwb(p + lo, y.n - lo, fhi);
+
+				if (dg != NULL) {
+					const uint8_t *o = idx->pos + y.off;
+					/* predecessors we skipped could be
+					 * anywhere */
+					const int any = !!(stop & w >> 1U);
+
+					for (size_t j = lo; j < hi; j++) {
+						hit(qc, cc, p[j] - 1U, w);
+						diag(dg + p[j] - 1U,
+						     i, o[j], w, any);
+					}
+				} else {
+					for (size_t j = lo; j < hi; j++) {
+						hit(qc, cc, p[j] - 1U, w);
+					}
+				}
+				nscan += hi - lo;
 			}
-			nq += nqgrams[y];
-			qq += 1. / (double)nqgrams[y];
+			nq += y.n;
+			qq += 1. / (double)y.n;
 			w <<= 1U;
 		}
 
-		/* make up candidates */
-		for (size_t i = 0U; i < n; i++) {
-			/* look up factors in global qgram array */
-			const qgram_t y = x[i];
-			for (size_t j = 0U; j < nqgrams[y]; j++) {
-				const size_t k = qgrams[y][j] - 1U;
-				cc[k / 64U] |= (uint_fast64_t)(1ULL << k % 64U);
-			}
-		}
-
 		/* find longest longest streaks */
 		size_t max = 2U;
 		size_t nstrk = 0U;
 		uint_fast64_t maxs = 0U;
 
-		for (size_t i = 0U; i <= nfactor / 64U; i++) {
-			for (uint_fast64_t c = cc[i], j = 0U; c; c >>= 1U, j++) {
+		for (size_t i = (flo - 1U) / 64U; i <= (fhi - 1U) / 64U; i++) {
+			/* deleted factors are no candidates */
+			const uint_fast64_t dead =
+				idx->tomb != NULL ? idx->tomb[i] : 0U;
+
+			for (uint_fast64_t c = cc[i] & ~dead, j = 0U;
+			     c; c >>= 1U, j++) {
 				const size_t k = 64U * i + j;
 				size_t s;
 
 				if (LIKELY(!(c & 0b1U))) {
 					continue;
-				} else if (LIKELY((s = lstrk(qc[k])) < max)) {
-					/* nothing to see here */
+				} else if (LIKELY((s = streak(qc, dg, k,
+							      stop)) < max)) {
+					/* nothing to see here, not even with
+					 * all stop grams credited */
 					continue;
-				} else if (UNLIKELY(s > max)) {
+				} else if (UNLIKELY(stop)) {
+					const uint_fast64_t cr = credit(
+						idx, mkqgrams, k + 1U, x, stop);
+
+					qc[k] |= cr;
+					if (dg != NULL) {
+						/* links to stop grams were
+						 * assumed, get the real ones */
+						dg[k].lnk = links(
+							idx, mkqgrams,
+							k + 1U, x, n);
+					}
+					if ((s = streak(qc, dg, k, 0U)) < max) {
+						continue;
+					}
+				}
+				if (UNLIKELY(s > max)) {
 					max = s;
 					nstrk = 0U;
 					maxs = qc[k];
@@ -389,6 +854,11 @@ Error: cannot open right input file");
 
 		if (max < 3U) {
 			continue;
+		} else if (ford != NULL) {
+			/* ids are ordered by length, rows go in input order
+			 * and the first of them determines MAXS */
+			qsort(strk, nstrk, sizeof(*strk), cmp_ford);
+			maxs = qc[strk[0U]];
 		}
 
 		size_t mq = 0U;
@@ -398,53 +868,68 @@ Error: cannot open right input file");
 			if (!(maxs & 0b1U)) {
 				continue;
 			}
-			const qgram_t y = x[j];
-			mq += nqgrams[y];
-			oq += 1. / (double)nqgrams[y];
+			const struct qgdir_s y = qgidx_lookup(idx, x[j]);
+			mq += y.n;
+			oq += 1. / (double)y.n;
 		}
 
 		for (size_t j = 0U; j < nstrk; j++) {
 			const size_t i = strk[j];
-			size_t plen = poff[i + 1U] - poff[i];
-			const size_t m = mkqgrams(NULL, pool + poff[i], plen);
-
-			fwrite(pool + poff[i], 1, plen, stdout);
-			fputc('\t', stdout);
-			fwrite(line, 1, nrd, stdout);
-			fputc('\t', stdout);
-			fprintf(stdout, "%zu", max);
-			fputc('\t', stdout);
-			fprintf(stdout, "%zu", m);
-			fputc('\t', stdout);
-			fprintf(stdout, "%zu", n);
-			fputc('\t', stdout);
-			fprintf(stdout, "%zu", mq);
-			fputc('\t', stdout);
-			fprintf(stdout, "%zu", nq);
-			fputc('\t', stdout);
-			fprintf(stdout, "%g", oq);
-			fputc('\t', stdout);
-			fprintf(stdout, "%g", qq);
-			fputc('\n', stdout);
+			size_t plen;
+			const char *str = qgidx_factor(idx, i + 1U, &plen);
+			const size_t m = mkqgrams(NULL, str, plen);
+			const char *shd = qgidx_shard(idx, i + 1U);
+			size_t mul = 1U;
+
+			if (argi->all_duplicates_flag && idx->fmul) {
+				/* one row for every duplicate */
+				mul = idx->fmul[i];
+			}
+			do {
+				fwrite(str, 1, plen, stdout);
+				fputc('\t', stdout);
+				fwrite(line, 1, nrd, stdout);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", max);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", m);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", n);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", mq);
+				fputc('\t', stdout);
+				fprintf(stdout, "%zu", nq);
+				fputc('\t', stdout);
+				fprintf(stdout, "%g", oq);
+				fputc('\t', stdout);
+				fprintf(stdout, "%g", qq);
+				if (shd != NULL) {
+					fputc('\t', stdout);
+					fputs(shd, stdout);
+				}
+				fputc('\n', stdout);
+			} while (--mul);
 		}
 	}
-	fclose(fp2);
+	fclose(rght.fp);
+	rc |= rght.err;
 	free(line);
 
+	if (argi->stats_flag) {
+		fprintf(stderr, "postings scanned\t%zu\n", nscan);
+		fprintf(stderr, "postings skipped\t%zu\n", nskip);
+	}
+
 	free(qc);
 	free(cc);
+	free(dg);
 
 	if (zstrk) {
 		free(strk);
 	}
 
-	for (size_t i = 0U; i < countof(qgrams); i++) {
-		if (qgrams[i]) {
-			free(qgrams[i]);
-		}
-	}
-	free(pool);
-	free(poff);
+fre:
+	qgidx_free(idx);
 
 out:
 	yuck_free(argi);
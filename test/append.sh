@@ -0,0 +1,12 @@
+#!/bin/sh
+## appending lines to a saved index is like building it from all lines
+. "${srcdir:-.}/common.sh"
+
+head -n 1000 "${left}" > "${tmp}/l1"
+tail -n +1001 "${left}" > "${tmp}/l2"
+for opt in "" "-p"; do
+	direct ${opt} > "${tmp}/direct"
+	"${qgjoin}" ${opt} -s "${tmp}/idx" "${tmp}/l1"
+	"${qgjoin}" -l "${tmp}/idx" -A "${tmp}/l2"
+	"${qgjoin}" -l "${tmp}/idx" "${rght}" | diff "${tmp}/direct" -
+done
@@ -0,0 +1,8 @@
+#!/bin/sh
+## clustered line ids still give rows in input order
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct --cluster | diff "${tmp}/plain" -
+direct --cluster -r | diff "${tmp}/plain" -
+roundtrip --cluster
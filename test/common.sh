@@ -0,0 +1,38 @@
+## sourced by the tests, sets up the tools, the fixtures and a
+## scratch directory that goes away with the test
+set -e
+: "${srcdir:=.}" "${top_builddir:=..}"
+qgjoin="${top_builddir}/src/qgjoin"
+qgindex="${top_builddir}/src/qgindex"
+tmp=$(mktemp -d)
+trap 'rm -rf "${tmp}"' EXIT
+
+## enough lines to fill packed blocks, roaring bitmaps and the work
+## of several threads
+left="${tmp}/left"
+rght="${tmp}/rght"
+awk -v n=16000 -v left="${left}" -v rght="${rght}" -f "${srcdir}/s02.awk"
+
+direct()
+{
+## rows of the join with options $@ against the index built in memory
+	"${qgjoin}" "$@" "${left}" "${rght}"
+}
+
+roundtrip()
+{
+## rows of the join with options $@ against the saved index are those
+## against the index built in memory
+	direct "$@" > "${tmp}/direct"
+	"${qgjoin}" "$@" -s "${tmp}/idx" "${left}"
+	"${qgjoin}" "$@" -l "${tmp}/idx" "${rght}" > "${tmp}/loaded"
+	diff "${tmp}/direct" "${tmp}/loaded"
+}
+
+fails()
+{
+## command $@ must exit non-zero
+	if "$@" > /dev/null 2>&1; then
+		return 1
+	fi
+}
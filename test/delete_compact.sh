@@ -0,0 +1,37 @@
+#!/bin/sh
+## deleted lines no longer join, and compacting gives the index that
+## would have been built without them
+. "${srcdir:-.}/common.sh"
+
+awk 'NR % 7 == 3' "${left}" | sort -u > "${tmp}/del"
+grep -v -x -F -f "${tmp}/del" "${left}" > "${tmp}/keep"
+for opt in "" "-p" "-r" "-P" "-t 0.5" "--front-code"; do
+	## the threshold is one of the join, not of the index
+	case "${opt}" in
+	-t*) thr="${opt}";;
+	*) thr="";;
+	esac
+	"${qgjoin}" ${opt} "${tmp}/keep" "${rght}" > "${tmp}/direct"
+	"${qgjoin}" ${opt} -s "${tmp}/kidx" "${tmp}/keep"
+	"${qgjoin}" ${opt} -s "${tmp}/idx" "${left}"
+	"${qgindex}" delete "${tmp}/idx" "${tmp}/del"
+	## postings of deleted lines still count towards mq, nq and oq
+	"${qgjoin}" ${thr} -l "${tmp}/idx" "${rght}" |
+		cut -f 1-5 > "${tmp}/deleted"
+	cut -f 1-5 "${tmp}/direct" | diff - "${tmp}/deleted"
+
+	"${qgindex}" compact "${tmp}/idx"
+	"${qgjoin}" ${thr} -l "${tmp}/idx" "${rght}" | diff "${tmp}/direct" -
+	## a build pools duplicate lines as they come, compact only once
+	"${qgindex}" stat "${tmp}/kidx" |
+		grep -v '^bytes [pot]' > "${tmp}/built"
+	"${qgindex}" stat "${tmp}/idx" | grep -v '^bytes [pot]' |
+		diff "${tmp}/built" -
+done
+
+## compacting on request
+"${qgjoin}" -s "${tmp}/idx" "${left}"
+"${qgindex}" delete -c 0.01 "${tmp}/idx" "${tmp}/del"
+"${qgindex}" stat "${tmp}/idx" | grep -q '^deleted	0$'
+fails "${qgindex}" delete -c 2 "${tmp}/idx" "${tmp}/del"
+fails "${qgindex}" delete -c x "${tmp}/idx" "${tmp}/del"
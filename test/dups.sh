@@ -0,0 +1,12 @@
+#!/bin/sh
+## duplicate left lines join once, or once per duplicate with -a
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+awk '!seen[$0]++' "${left}" > "${tmp}/uniq"
+"${qgjoin}" "${tmp}/uniq" "${rght}" | diff "${tmp}/plain" -
+
+awk -F '\t' 'NR == FNR {m[$0]++; next} {for (i = 0; i < m[$1]; i++) print}' \
+	"${left}" "${tmp}/plain" > "${tmp}/all"
+direct -a | diff "${tmp}/all" -
+roundtrip -a
@@ -0,0 +1,13 @@
+#!/bin/sh
+## front-coded left lines give the rows of plain ones
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct --front-code | diff "${tmp}/plain" -
+roundtrip --front-code
+
+head -n 1000 "${left}" > "${tmp}/l1"
+tail -n +1001 "${left}" > "${tmp}/l2"
+"${qgjoin}" --front-code -s "${tmp}/idx" "${tmp}/l1"
+"${qgjoin}" -l "${tmp}/idx" -A "${tmp}/l2"
+"${qgjoin}" -l "${tmp}/idx" "${rght}" | diff "${tmp}/plain" -
@@ -0,0 +1,11 @@
+#!/bin/sh
+## legacy qgram keys round-trip, exact ones tell more qgrams apart
+. "${srcdir:-.}/common.sh"
+
+roundtrip --legacy-keys
+
+direct > "${tmp}/plain"
+direct --key-stats 2> "${tmp}/stats" | diff "${tmp}/plain" -
+awk -F '\t' '{v[$1] = $2}
+	END {exit !(v["keys exact"] >= v["keys legacy"] && v["keys legacy"])}' \
+	"${tmp}/stats"
@@ -0,0 +1,16 @@
+#!/bin/sh
+## stop grams above --max-df, counts and fractions of the left lines
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct --max-df=16000 | diff "${tmp}/plain" -
+
+## a fraction of the distinct left lines is a count
+n=$(sort -u "${left}" | wc -l)
+direct --max-df=0.05 > "${tmp}/frac"
+direct --max-df=$((n / 20)) | diff "${tmp}/frac" -
+roundtrip --max-df=0.05
+
+for df in 0 -1 x 0.5x nan ""; do
+	fails direct --max-df="${df}"
+done
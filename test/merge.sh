@@ -0,0 +1,21 @@
+#!/bin/sh
+## an index merged from shards joins like one built from all lines and
+## names the shard of every left line
+. "${srcdir:-.}/common.sh"
+
+## shards keep their factors apart, so give them distinct lines
+awk '!seen[$0]++' "${left}" > "${tmp}/uniq"
+head -n 5000 "${tmp}/uniq" > "${tmp}/l1"
+tail -n +5001 "${tmp}/uniq" > "${tmp}/l2"
+for opt in "" "-p" "-r" "-P"; do
+	"${qgjoin}" ${opt} "${tmp}/uniq" "${rght}" > "${tmp}/direct"
+	"${qgjoin}" ${opt} -s "${tmp}/s1" "${tmp}/l1"
+	"${qgjoin}" ${opt} -s "${tmp}/s2" "${tmp}/l2"
+	"${qgindex}" merge -o "${tmp}/idx" "${tmp}/s1" "${tmp}/s2"
+	"${qgjoin}" -l "${tmp}/idx" "${rght}" > "${tmp}/merged"
+	awk -F '\t' -v s1="${tmp}/s1" -v s2="${tmp}/s2" '
+		NR == FNR {one[$0]; next}
+		{print $0 "\t" ($1 in one ? s1 : s2)}' \
+		"${tmp}/l1" "${tmp}/direct" | diff - "${tmp}/merged"
+done
+"${qgindex}" stat "${tmp}/idx" | grep -q "^shard	${tmp}/s1	5000$"
@@ -0,0 +1,9 @@
+#!/bin/sh
+## left lines that cannot be mapped or lack the final newline join like
+## a regular file
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+"${qgjoin}" /dev/stdin "${rght}" < "${left}" | diff "${tmp}/plain" -
+awk 'NR > 1 {printf "\n"} {printf "%s", $0}' "${left}" > "${tmp}/nonl"
+"${qgjoin}" "${tmp}/nonl" "${rght}" | diff "${tmp}/plain" -
@@ -0,0 +1,7 @@
+#!/bin/sh
+## packed posting lists give the rows of plain ones
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct -p | diff "${tmp}/plain" -
+roundtrip -p
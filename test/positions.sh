@@ -0,0 +1,16 @@
+#!/bin/sh
+## positional postings only drop rows whose qgrams are out of line
+. "${srcdir:-.}/common.sh"
+
+roundtrip -P
+cut -f 1-2 "${tmp}/direct" | sort > "${tmp}/pos"
+direct | cut -f 1-2 | sort | comm -13 - "${tmp}/pos" > "${tmp}/extra"
+test ! -s "${tmp}/extra"
+
+direct -P -j 4 | diff "${tmp}/direct" -
+
+head -n 1000 "${left}" > "${tmp}/l1"
+tail -n +1001 "${left}" > "${tmp}/l2"
+"${qgjoin}" -P -s "${tmp}/idx" "${tmp}/l1"
+"${qgjoin}" -l "${tmp}/idx" -A "${tmp}/l2"
+"${qgjoin}" -l "${tmp}/idx" "${rght}" | diff "${tmp}/direct" -
@@ -0,0 +1,28 @@
+#!/bin/sh
+## the prefix filter finds the pairs above the threshold
+. "${srcdir:-.}/common.sh"
+
+cat > "${tmp}/expected" <<'EOF_'
+Fresenius Medical Care AG & Co KGaA	FRESENIUS MEDICAL CARE AG &	19	0.76
+Fresenius Medical Care AG & Co KGaA	FRESENIUS MEDICAL CARE A-NEW	17	0.607143
+CONSTELLATION BRANDS INC	CONSTELLATION BRANDS INC-A	18	0.947368
+PINNACLE WEST CAPITAL	Pinnacle West Capital	15	1
+PINNACLE WEST CAPITAL	Pinnacle West  Capital	15	1
+EOF_
+"${qgjoin}" --prefix -t 0.5 "${srcdir}/s01_left.strings" \
+	"${srcdir}/s01_rght.strings" | diff "${tmp}/expected" -
+
+roundtrip --prefix -t 0.5
+awk -F '\t' '$4 < 0.5 {exit 1}' "${tmp}/direct"
+
+## pairs above 0.8 are above 0.5
+direct --prefix -t 0.8 | sort > "${tmp}/high"
+sort "${tmp}/direct" | comm -23 "${tmp}/high" - > "${tmp}/extra"
+test ! -s "${tmp}/extra"
+
+head -n 100 "${rght}" > "${tmp}/r1"
+tail -n +101 "${rght}" > "${tmp}/r2"
+"${qgjoin}" --prefix -t 0.5 -l "${tmp}/idx" "${tmp}/r1" "${tmp}/r2" | \
+	diff "${tmp}/direct" -
+
+fails direct --prefix
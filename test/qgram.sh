@@ -0,0 +1,15 @@
+#!/bin/sh
+## indexes keep the qgram length they were built with
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct -q 5 | diff "${tmp}/plain" -
+for q in 3 4 6 7 8; do
+	roundtrip -q ${q}
+	## loading ignores the length
+	"${qgjoin}" -l "${tmp}/idx" "${rght}" | diff "${tmp}/direct" -
+done
+
+for q in 2 9 x 5x ""; do
+	fails direct -q "${q}"
+done
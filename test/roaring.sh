@@ -0,0 +1,14 @@
+#!/bin/sh
+## roaring containers give the rows of plain posting lists
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+direct -r | diff "${tmp}/plain" -
+direct -r -j 4 | diff "${tmp}/plain" -
+roundtrip -r
+
+head -n 1000 "${left}" > "${tmp}/l1"
+tail -n +1001 "${left}" > "${tmp}/l2"
+"${qgjoin}" -r -s "${tmp}/idx" "${tmp}/l1"
+"${qgjoin}" -l "${tmp}/idx" -A "${tmp}/l2"
+"${qgjoin}" -l "${tmp}/idx" "${rght}" | diff "${tmp}/plain" -
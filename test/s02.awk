@@ -0,0 +1,66 @@
+## left lines LEFT and right lines RGHT in the fashion of s01, N left
+## lines of company names, some of them duplicates, and right lines
+## that are spelling variants of some of them
+function rnd()
+{
+	## Park-Miller, exact in doubles on every awk
+	seed = (seed * 16807) % 2147483647
+	return seed / 2147483647
+}
+
+function pick(a, n)
+{
+	## bias towards the front of A
+	return a[int(n * rnd() * rnd()) + 1]
+}
+
+BEGIN {
+	seed = 42
+	nw = split("CONSTELLATION PINNACLE FRESENIUS MEDICAL CAPITAL " \
+		"BRANDS WEST SOFTWARE INVESCO ENTERTAINMENT ATLANTIC " \
+		"PACIFIC NORTHERN SOUTHERN AMERICAN EUROPEAN ASIA UNITED " \
+		"GENERAL ELECTRIC MOTORS ENERGY MINING SYSTEMS MEDIA FOODS " \
+		"STEEL BANK INSURANCE TECHNOLOGIES RESOURCES PHARMA " \
+		"LOGISTICS CHEMICALS TELECOM RETAIL SHIPPING AIRLINES " \
+		"PROPERTIES SERVICES", w, " ")
+	ns = split("INC CORP LTD PLC AG SA NV CO SE KGAA -A -NEW", sfx, " ")
+
+	for (i = 1; i <= n; i++) {
+		if (i > 100 && rnd() < 0.02) {
+			## duplicate of an earlier line
+			l[i] = l[int((i - 1) * rnd()) + 1]
+		} else {
+			s = pick(w, nw)
+			for (k = int(3 * rnd()); k > 0; k--) {
+				s = s " " pick(w, nw)
+			}
+			if (rnd() < 0.5) {
+				s = s " HOLDINGS"
+			}
+			if (rnd() < 0.3) {
+				s = s " " int(1000 * rnd())
+			}
+			l[i] = s " " pick(sfx, ns)
+		}
+		print l[i] > left
+	}
+	for (i = 1; i <= n / 40; i++) {
+		s = l[int(n * rnd()) + 1]
+		r = rnd()
+		if (r < 0.25) {
+			## mixed case
+			s = substr(s, 1, 1) tolower(substr(s, 2))
+		} else if (r < 0.5) {
+			## drop the last word
+			sub(/ [^ ]*$/, "", s)
+		} else if (r < 0.75) {
+			## double a blank
+			sub(/ /, "  ", s)
+		} else {
+			## typo
+			p = int(length(s) * rnd()) + 1
+			s = substr(s, 1, p - 1) "X" substr(s, p + 1)
+		}
+		print s > rght
+	}
+}
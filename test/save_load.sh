@@ -0,0 +1,20 @@
+#!/bin/sh
+## joins against a saved and loaded index give the rows of a join
+## against the index built in memory
+. "${srcdir:-.}/common.sh"
+
+roundtrip
+
+## every argument is a right file, stdin if there are none
+head -n 100 "${rght}" > "${tmp}/r1"
+tail -n +101 "${rght}" > "${tmp}/r2"
+"${qgjoin}" -l "${tmp}/idx" "${tmp}/r1" "${tmp}/r2" | diff "${tmp}/direct" -
+"${qgjoin}" -l "${tmp}/idx" < "${rght}" | diff "${tmp}/direct" -
+fails "${qgjoin}" -l "${tmp}/idx" "${tmp}/r1" "${tmp}/none"
+
+## and the same for the small fixture
+"${qgjoin}" "${srcdir}/s01_left.strings" "${srcdir}/s01_rght.strings" \
+	> "${tmp}/direct"
+"${qgjoin}" -s "${tmp}/idx" "${srcdir}/s01_left.strings"
+"${qgjoin}" -l "${tmp}/idx" "${srcdir}/s01_rght.strings" | \
+	diff "${tmp}/direct" -
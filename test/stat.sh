@@ -0,0 +1,17 @@
+#!/bin/sh
+## a saved index looks like the one built in memory
+. "${srcdir:-.}/common.sh"
+
+for opt in "" "-p" "-r"; do
+	"${qgindex}" stat -b ${opt} "${left}" |
+		grep -v '^bytes committed\|^bytes slack' > "${tmp}/built"
+	"${qgjoin}" ${opt} -s "${tmp}/idx" "${left}"
+	"${qgindex}" stat "${tmp}/idx" | diff "${tmp}/built" -
+done
+
+n=$(sort -u "${left}" | wc -l)
+grep -q "^factors	${n}\$" "${tmp}/built"
+"${qgindex}" stat -n 3 "${tmp}/idx" > /dev/null
+fails "${qgindex}" stat -n x "${tmp}/idx"
+fails "${qgindex}" stat -b -q 9 "${left}"
+fails "${qgindex}" stat -b -j 0 "${left}"
@@ -0,0 +1,14 @@
+#!/bin/sh
+## indexes built on several threads give the rows of one built on one
+. "${srcdir:-.}/common.sh"
+
+direct > "${tmp}/plain"
+for j in 2 4 7; do
+	direct -j ${j} | diff "${tmp}/plain" -
+	direct -j ${j} -p | diff "${tmp}/plain" -
+done
+roundtrip -j 4
+
+for j in 0 x 4x -1 ""; do
+	fails direct -j "${j}"
+done
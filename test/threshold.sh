@@ -0,0 +1,25 @@
+#!/bin/sh
+## length bands never drop rows whose lines are within the threshold
+. "${srcdir:-.}/common.sh"
+
+## all lines are within this
+direct > "${tmp}/plain"
+direct -t 0.01 | diff "${tmp}/plain" -
+
+## no line joins out of band
+direct -t 0.9 | \
+	awk -F '\t' '$4 < 0.9 * $5 - 1e-9 || $5 < 0.9 * $4 - 1e-9 {exit 1}'
+
+roundtrip -t 0.5
+direct -t 0.5 -j 4 | diff "${tmp}/direct" -
+direct -t 0.5 -p | diff "${tmp}/direct" -
+
+## fewer lines than qgrams in the longest of them
+"${qgjoin}" "${srcdir}/s01_left.strings" "${srcdir}/s01_rght.strings" \
+	> "${tmp}/plain"
+"${qgjoin}" -t 0.5 "${srcdir}/s01_left.strings" \
+	"${srcdir}/s01_rght.strings" | diff "${tmp}/plain" -
+
+for t in 0 1.1 -0.5 x 0.5x ""; do
+	fails direct -t "${t}"
+done
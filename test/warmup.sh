@@ -0,0 +1,12 @@
+#!/bin/sh
+## warming up a loaded index changes no rows and says when it is ready
+. "${srcdir:-.}/common.sh"
+
+roundtrip
+"${qgjoin}" -w -l "${tmp}/idx" "${rght}" 2> "${tmp}/ready" | \
+	diff "${tmp}/direct" -
+grep -q '^time to ready	' "${tmp}/ready"
+"${qgjoin}" -w -j 2 -l "${tmp}/idx" "${rght}" 2> /dev/null | \
+	diff "${tmp}/direct" -
+
+fails direct -w